@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+#include "astfile.h"
+
+extern thread_local int node_lineno;
+
+namespace {
+
+const char kAstMagic[] = "COOLAST";  // and its '\0'
+
+// Bump when the format changes
+const int kAstVersion = 1;
+
+enum Section { ID_SECTION, INT_SECTION, STR_SECTION, SECTIONS };
+
+// Writes the tree, in two passes: the first only numbers the symbols,
+// so their sections can go before the tree
+struct Writer {
+  std::string& out;
+  bool numbering;
+  std::vector<Symbol> symbols[SECTIONS];
+  std::unordered_map<Symbol, int> numbers[SECTIONS];
+
+  void put_number(unsigned long n) {
+    if (numbering) { return; }
+    do {
+      unsigned char byte = n & 0x7f;
+      n >>= 7;
+      out += (char) (n ? byte | 0x80 : byte);
+    } while (n);
+  }
+
+  void put(Symbol s, Section section) {
+    if (numbering) {
+      if (s && numbers[section].emplace(s, 0).second) {
+        symbols[section].push_back(s);
+      }
+      return;
+    }
+    put_number(s ? numbers[section].at(s) : 0);
+  }
+
+  void put(tree_node* node) {
+    put_number(node->get_kind());
+    put_number(node->get_line_number());
+    visit(node, *this);
+  }
+
+  void put(Expression e) {
+    put(static_cast<tree_node*>(e));
+    put(e->get_type(), ID_SECTION);
+  }
+
+  template<class Elem>
+  void put(list_node<Elem>* list) {
+    put_number(list->len());
+    for (auto e: *list) { put(e); }
+  }
+
+  // Number the symbols in the order of their index in each table
+  void number_symbols() {
+    for (int i = 0; i < SECTIONS; i++) {
+      std::sort(symbols[i].begin(), symbols[i].end(), [](Symbol a, Symbol b) {
+        return a->get_index() < b->get_index();
+      });
+      for (size_t j = 0; j < symbols[i].size(); j++) {
+        numbers[i][symbols[i][j]] = j + 1;
+      }
+    }
+  }
+
+  void put_sections() {
+    for (auto& section: symbols) {
+      put_number(section.size());
+      for (auto s: section) {
+        put_number(s->get_len());
+        out.append(s->get_string(), s->get_len());
+      }
+    }
+  }
+
+  void operator()(program_class* p) { put(p->classes); }
+
+  void operator()(class__class* c) {
+    put(c->name, ID_SECTION);
+    put(c->parent, ID_SECTION);
+    put(c->features);
+    put(c->filename, STR_SECTION);
+  }
+
+  void operator()(method_class* m) {
+    put(m->name, ID_SECTION);
+    put(m->formals);
+    put(m->return_type, ID_SECTION);
+    put(m->expr);
+  }
+
+  void operator()(attr_class* a) {
+    put(a->name, ID_SECTION);
+    put(a->type_decl, ID_SECTION);
+    put(a->init);
+  }
+
+  void operator()(formal_class* f) {
+    put(f->name, ID_SECTION);
+    put(f->type_decl, ID_SECTION);
+  }
+
+  void operator()(branch_class* b) {
+    put(b->name, ID_SECTION);
+    put(b->type_decl, ID_SECTION);
+    put(b->expr);
+  }
+
+  void operator()(assign_class* e) {
+    put(e->name, ID_SECTION);
+    put(e->expr);
+  }
+
+  void operator()(static_dispatch_class* e) {
+    put(e->expr);
+    put(e->type_name, ID_SECTION);
+    put(e->name, ID_SECTION);
+    put(e->actual);
+  }
+
+  void operator()(dispatch_class* e) {
+    put(e->expr);
+    put(e->name, ID_SECTION);
+    put(e->actual);
+  }
+
+  void operator()(cond_class* e) {
+    put(e->pred);
+    put(e->then_exp);
+    put(e->else_exp);
+  }
+
+  void operator()(loop_class* e) {
+    put(e->pred);
+    put(e->body);
+  }
+
+  void operator()(typcase_class* e) {
+    put(e->expr);
+    put(e->cases);
+  }
+
+  void operator()(block_class* e) { put(e->body); }
+
+  void operator()(let_class* e) {
+    put(e->identifier, ID_SECTION);
+    put(e->type_decl, ID_SECTION);
+    put(e->init);
+    put(e->body);
+  }
+
+#define BINARY_WRITER(name) \
+  void operator()(name##_class* e) { put(e->e1); put(e->e2); }
+  BINARY_WRITER(plus)
+  BINARY_WRITER(sub)
+  BINARY_WRITER(mul)
+  BINARY_WRITER(divide)
+  BINARY_WRITER(lt)
+  BINARY_WRITER(eq)
+  BINARY_WRITER(leq)
+#undef BINARY_WRITER
+
+  void operator()(neg_class* e) { put(e->e1); }
+
+  void operator()(comp_class* e) { put(e->e1); }
+
+  void operator()(isvoid_class* e) { put(e->e1); }
+
+  void operator()(int_const_class* e) { put(e->token, INT_SECTION); }
+
+  void operator()(string_const_class* e) { put(e->token, STR_SECTION); }
+
+  void operator()(bool_const_class* e) { put_number(e->val); }
+
+  void operator()(new__class* e) { put(e->type_name, ID_SECTION); }
+
+  void operator()(object_class* e) { put(e->name, ID_SECTION); }
+
+  // no_expr
+  void operator()(tree_node*) {}
+};
+
+// Reads the tree back.  Past the end of the text or at anything out of
+// place ok turns false, and what is read from then on is 0 or NULL.
+struct Reader {
+  const unsigned char* p;
+  const unsigned char* end;
+  bool ok;
+  std::vector<Symbol> symbols[SECTIONS];
+
+  unsigned long number() {
+    unsigned long n = 0;
+    for (int shift = 0; ok; shift += 7) {
+      if (p == end || shift > 56) { break; }
+      unsigned char byte = *p++;
+      n |= (unsigned long) (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) { return n; }
+    }
+    ok = false;
+    return 0;
+  }
+
+  Symbol symbol(Section section) {
+    auto n = number();
+    if (n > symbols[section].size()) { ok = false; }
+    return n == 0 || !ok ? NULL : symbols[section][n - 1];
+  }
+
+  void get_sections() {
+    for (int i = 0; i < SECTIONS && ok; i++) {
+      auto count = number();
+      for (unsigned long j = 0; j < count && ok; j++) {
+        auto len = number();
+        if (len > (unsigned long) (end - p)) {
+          ok = false;
+          break;
+        }
+        auto s = (const char*) p;
+        p += len;
+        switch (i) {
+          case ID_SECTION:
+            symbols[i].push_back(idtable.add_string(s, len));
+            break;
+          case INT_SECTION:
+            symbols[i].push_back(inttable.add_string(s, len));
+            break;
+          default:
+            symbols[i].push_back(stringtable.add_string(s, len));
+            break;
+        }
+      }
+    }
+  }
+
+  // A node of the kind of the next number, if it is one of kinds
+  NodeKind kind(std::initializer_list<NodeKind> kinds) {
+    auto n = number();
+    for (auto k: kinds) {
+      if (n == k) { return k; }
+    }
+    ok = false;
+    return list_kind;
+  }
+
+  Program program() {
+    kind({program_kind});
+    int line = number();
+    auto classes = list(&Reader::class_, nil_Classes, single_Classes, append_Classes);
+    node_lineno = line;
+    return ::program(classes);
+  }
+
+  Class_ class_() {
+    kind({class__kind});
+    int line = number();
+    auto name = symbol(ID_SECTION);
+    auto parent = symbol(ID_SECTION);
+    auto features = list(&Reader::feature, nil_Features, single_Features, append_Features);
+    auto filename = symbol(STR_SECTION);
+    node_lineno = line;
+    return ::class_(name, parent, features, filename);
+  }
+
+  Feature feature() {
+    auto k = kind({method_kind, attr_kind});
+    int line = number();
+    auto name = symbol(ID_SECTION);
+    if (k == method_kind) {
+      auto formals = list(&Reader::formal, nil_Formals, single_Formals, append_Formals);
+      auto return_type = symbol(ID_SECTION);
+      auto expr = expression();
+      node_lineno = line;
+      return method(name, formals, return_type, expr);
+    }
+    auto type_decl = symbol(ID_SECTION);
+    auto init = expression();
+    node_lineno = line;
+    return attr(name, type_decl, init);
+  }
+
+  Formal formal() {
+    kind({formal_kind});
+    int line = number();
+    auto name = symbol(ID_SECTION);
+    auto type_decl = symbol(ID_SECTION);
+    node_lineno = line;
+    return ::formal(name, type_decl);
+  }
+
+  Case branch() {
+    kind({branch_kind});
+    int line = number();
+    auto name = symbol(ID_SECTION);
+    auto type_decl = symbol(ID_SECTION);
+    auto expr = expression();
+    node_lineno = line;
+    return ::branch(name, type_decl, expr);
+  }
+
+  Expressions expressions() {
+    return list(&Reader::expression, nil_Expressions, single_Expressions,
+                append_Expressions);
+  }
+
+  Expression expression() {
+    auto k = number();
+    int line = number();
+    Expression e = NULL;
+    switch (k) {
+      case assign_kind: {
+        auto name = symbol(ID_SECTION);
+        auto expr = expression();
+        node_lineno = line;
+        e = assign(name, expr);
+        break;
+      }
+      case static_dispatch_kind: {
+        auto expr = expression();
+        auto type_name = symbol(ID_SECTION);
+        auto name = symbol(ID_SECTION);
+        auto actual = expressions();
+        node_lineno = line;
+        e = static_dispatch(expr, type_name, name, actual);
+        break;
+      }
+      case dispatch_kind: {
+        auto expr = expression();
+        auto name = symbol(ID_SECTION);
+        auto actual = expressions();
+        node_lineno = line;
+        e = dispatch(expr, name, actual);
+        break;
+      }
+      case cond_kind: {
+        auto pred = expression();
+        auto then_exp = expression();
+        auto else_exp = expression();
+        node_lineno = line;
+        e = cond(pred, then_exp, else_exp);
+        break;
+      }
+      case loop_kind: {
+        auto pred = expression();
+        auto body = expression();
+        node_lineno = line;
+        e = loop(pred, body);
+        break;
+      }
+      case typcase_kind: {
+        auto expr = expression();
+        auto cases = list(&Reader::branch, nil_Cases, single_Cases, append_Cases);
+        node_lineno = line;
+        e = typcase(expr, cases);
+        break;
+      }
+      case block_kind: {
+        auto body = expressions();
+        node_lineno = line;
+        e = block(body);
+        break;
+      }
+      case let_kind: {
+        auto identifier = symbol(ID_SECTION);
+        auto type_decl = symbol(ID_SECTION);
+        auto init = expression();
+        auto body = expression();
+        node_lineno = line;
+        e = let(identifier, type_decl, init, body);
+        break;
+      }
+#define BINARY_READER(name)     \
+      case name##_kind: {       \
+        auto e1 = expression(); \
+        auto e2 = expression(); \
+        node_lineno = line;     \
+        e = name(e1, e2);       \
+        break;                  \
+      }
+      BINARY_READER(plus)
+      BINARY_READER(sub)
+      BINARY_READER(mul)
+      BINARY_READER(divide)
+      BINARY_READER(lt)
+      BINARY_READER(eq)
+      BINARY_READER(leq)
+#undef BINARY_READER
+#define UNARY_READER(name)      \
+      case name##_kind: {       \
+        auto e1 = expression(); \
+        node_lineno = line;     \
+        e = name(e1);           \
+        break;                  \
+      }
+      UNARY_READER(neg)
+      UNARY_READER(comp)
+      UNARY_READER(isvoid)
+#undef UNARY_READER
+      case int_const_kind: {
+        auto token = symbol(INT_SECTION);
+        node_lineno = line;
+        e = int_const(token);
+        break;
+      }
+      case string_const_kind: {
+        auto token = symbol(STR_SECTION);
+        node_lineno = line;
+        e = string_const(token);
+        break;
+      }
+      case bool_const_kind: {
+        Boolean val = number();
+        node_lineno = line;
+        e = bool_const(val);
+        break;
+      }
+      case new__kind: {
+        auto type_name = symbol(ID_SECTION);
+        node_lineno = line;
+        e = new_(type_name);
+        break;
+      }
+      case no_expr_kind:
+        node_lineno = line;
+        e = no_expr();
+        break;
+      case object_kind: {
+        auto name = symbol(ID_SECTION);
+        node_lineno = line;
+        e = object(name);
+        break;
+      }
+      default:
+        ok = false;
+        return no_expr();
+    }
+    e->set_type(symbol(ID_SECTION));
+    return e;
+  }
+
+  template<class Elem>
+  list_node<Elem>* list(Elem (Reader::*elem)(), list_node<Elem>* (*nil)(),
+                        list_node<Elem>* (*single)(Elem),
+                        list_node<Elem>* (*append)(list_node<Elem>*, list_node<Elem>*)) {
+    auto n = number();
+    auto l = nil();
+    for (unsigned long i = 0; i < n && ok; i++) {
+      l = append(l, single((this->*elem)()));
+    }
+    return l;
+  }
+};
+
+}
+
+bool is_ast_file(const char* text, size_t size) {
+  return size >= sizeof(kAstMagic) && memcmp(text, kAstMagic, sizeof(kAstMagic)) == 0;
+}
+
+// Written to a temporary file first, like the code cache, so that a
+// compiler reading the file never sees part of it
+bool write_ast(const char* name, Program program, AstStage stage) {
+  std::string text(kAstMagic, sizeof(kAstMagic));
+  Writer writer = {text, true, {}, {}};
+  writer.put(program);
+  writer.number_symbols();
+  writer.numbering = false;
+  writer.put_number(kAstVersion);
+  writer.put_number(stage);
+  writer.put_sections();
+  writer.put(program);
+
+  std::string temp = std::string(name) + "." + std::to_string(getpid());
+  {
+    std::ofstream out(temp, std::ios::binary);
+    out.write(text.data(), text.size());
+    if (!out) {
+      unlink(temp.c_str());
+      return false;
+    }
+  }
+  if (rename(temp.c_str(), name) != 0) {
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+Program read_ast(const char* text, size_t size, AstStage* stage, std::string& error) {
+  if (!is_ast_file(text, size)) {
+    error = "not an AST file";
+    return NULL;
+  }
+  auto begin = (const unsigned char*) text;
+  Reader reader = {begin + sizeof(kAstMagic), begin + size, true, {}};
+  if (reader.number() != kAstVersion) {
+    error = "AST file of another version of coolc";
+    return NULL;
+  }
+  auto n = reader.number();
+  reader.get_sections();
+  auto program = reader.program();
+  if (!reader.ok || n > AST_CHECKED || reader.p != reader.end) {
+    error = "corrupt AST file";
+    return NULL;
+  }
+  *stage = (AstStage) n;
+  return program;
+}
@@ -0,0 +1,42 @@
+#ifndef ASTFILE_H
+#define ASTFILE_H
+
+//
+// AST files.  coolc -A saves the AST of the program, as parsed (with -P)
+// or as type checked, in a compact binary form that coolc reads back in
+// place of the source: an AST file given as an input file is loaded
+// rather than lexed and parsed, and a type checked one given alone is
+// not type checked again.
+//
+// The file starts with kAstMagic, the version of the format and the
+// stage of the AST.  A section for each string table follows (the
+// identifiers, the integers and the strings), holding the strings the
+// tree refers to in the order of their index, and then the tree in
+// preorder: a node is its kind, its line number and its fields in the
+// order of its constructor, and an expression ends with its type.  A
+// symbol is the number of its string in the section of its table, from
+// 1, or 0 for none, and a list is its length and its elements.  Every
+// number is written in unsigned LEB128.
+//
+// Loaded in that order, the strings get the indexes parsing the source
+// would give them, so the code generated is the same.
+//
+
+#include <string>
+#include "cool-tree.h"
+
+enum AstStage { AST_PARSED, AST_CHECKED };
+
+// Whether the size bytes at text are an AST file
+bool is_ast_file(const char* text, size_t size);
+
+// Save program, at stage, to the file name.  False if it could not be
+// written.
+bool write_ast(const char* name, Program program, AstStage stage);
+
+// Load the AST file of size bytes at text, adding its strings to the
+// string tables.  Returns NULL, with the reason in error, if it is not
+// an AST file of this version.
+Program read_ast(const char* text, size_t size, AstStage* stage, std::string& error);
+
+#endif
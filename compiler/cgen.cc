@@ -20,7 +20,6 @@
 // fill in the rest.
 //
 //**************************************************************
-#include <typeinfo>
 #include <sstream>
 #include <vector>
 #include <map>
@@ -38,12 +37,11 @@ using std::stringstream;
 
 
 #define CODE_START \
-  if (cgen_debug) s << "# Code start for " << typeid(*this).name() << endl
+  if (cgen_debug) s << "# Code start for " << node_kind_name(kind) << endl
 
 #define CODE_END \
-  if (cgen_debug) s << "# Code end for " << typeid(*this).name() << endl
+  if (cgen_debug) s << "# Code end for " << node_kind_name(kind) << endl
 
-extern char* curr_filename;
 
 extern ClassTable* classtable;
 
@@ -60,11 +58,11 @@ extern ClassTable* classtable;
 //
 //*********************************************************
 
-void program_class::cgen(ostream& os) {
+void program_class::cgen(ostream& os, const CodeUnits& units) {
   // spim wants comments to start with '#'
   os << "# start of generated code\n";
 
-  classtable->code(os);
+  classtable->code(os, units);
 
   os << "\n# end of generated code\n";
 }
@@ -85,6 +83,12 @@ int assign_class::temporaries() {
   return expr->temporaries();
 }
 
+// The name of the file of the class being coded, for runtime errors
+static StringEntry* current_filename() {
+  auto cls = classtable->probe(Globals.get_current_class());
+  return stringtable.lookup_string(cls->get_filename()->get_string());
+}
+
 static void
 dispatch_impl(Expression expr,
               Expressions actual,
@@ -105,7 +109,7 @@ dispatch_impl(Expression expr,
   // Evaluate the object and save into $a0
   expr->code(s);
   emit_bne(ACC, ZERO, label, s);
-  emit_load_string(ACC, stringtable.lookup_string(curr_filename), s);
+  emit_load_string(ACC, current_filename(), s);
   emit_load_imm(T1, 1, s);
   emit_jal(DISP_ABORT, s);
 
@@ -113,7 +117,7 @@ dispatch_impl(Expression expr,
   // Load dispatch table
   s << load_table;
   // Load method address
-  int offset = Globals.get_method_offset_for_class(obj_type, name);
+  int offset = classtable->method_offset(obj_type, name);
   emit_load(T0, offset, T0, s);
   // Jump to the method definition
   emit_jalr(T0, s);
@@ -228,20 +232,20 @@ void typcase_class::code(ostream& s) {
   labels.push_back(label_abort);
   std::sort(patterns.begin(), patterns.end(),
             [](const BranchType& a, const BranchType& b) {
-              return Globals.classtag[a->type_decl] >
-                     Globals.classtag[b->type_decl];
+              return Globals.classtag.at(a->type_decl) >
+                     Globals.classtag.at(b->type_decl);
             });
   expr->code(s);
   // Now $a0 holds the evaluated expr
   // We should check if it is void (NULL)
   emit_bne(ACC, ZERO, labels[0], s);
-  emit_load_string(ACC, stringtable.lookup_string(curr_filename), s);
+  emit_load_string(ACC, current_filename(), s);
   emit_load_imm(T1, get_line_number(), s);
   emit_jal(CASE_ABORT2, s);
   for (auto i = 0; i < patterns.size(); i++) {
     auto cs = patterns[i];
-    auto tag_min = Globals.classtag[cs->type_decl];
-    auto tag_max = Globals.subclasstag_max[cs->type_decl];
+    auto tag_min = Globals.classtag.at(cs->type_decl);
+    auto tag_max = Globals.subclasstag_max.at(cs->type_decl);
     emit_label_def(labels[i], s);
     if (i == 0) { emit_load(T2, 0, ACC, s); }
     emit_blti(T2, tag_min, labels[i + 1], s);
@@ -301,7 +305,7 @@ void let_class::code(ostream& s) {
   CODE_START;
   // If there is no init-expr
   // we initialize this object with its default value
-  if (typeid(*init) == typeid(no_expr_class)) {
+  if (init->get_kind() == no_expr_kind) {
     if (type_decl == Int) {
       emit_partial_load_address(ACC, s);
       inttable.lookup_string(STR_ZERO)->code_ref(s);
@@ -340,6 +344,32 @@ int let_class::temporaries() {
 
 typedef void (* binary_operator)(char* dest, char* src1, char* src2, ostream& s);
 
+// Put an Int object holding the value in T1 into ACC: one of the
+// preallocated objects when the value is in the cache range, a fresh
+// one from the runtime otherwise.
+static void
+code_box_int(ostream& s) {
+  auto alloc = Globals.new_label();
+  auto done = Globals.new_label();
+  if (INT_CACHE_MAX >= INT_CACHE_MIN) {
+    emit_blti(T1, INT_CACHE_MIN, alloc, s);
+    emit_bgti(T1, INT_CACHE_MAX, alloc, s);
+    // ACC = INTCACHE + (T1 - INT_CACHE_MIN) * 20
+    static_assert(INT_CACHE_STRIDE == 20, "Int object layout changed");
+    emit_addiu(T1, T1, -INT_CACHE_MIN, s);
+    emit_sll(T2, T1, 4, s);
+    emit_sll(T1, T1, 2, s);
+    emit_addu(T1, T1, T2, s);
+    emit_load_address(ACC, INTCACHE, s);
+    emit_addu(ACC, ACC, T1, s);
+    emit_branch(done, s);
+  }
+  emit_label_def(alloc, s);
+  emit_move(T0, T1, s);
+  emit_jal(INT_ALLOC, s);
+  emit_label_def(done, s);
+}
+
 static void
 binary_calc_impl(binary_operator op,
                  Expression e1,
@@ -351,20 +381,14 @@ binary_calc_impl(binary_operator op,
   // with unmodified stack values
   emit_push(ACC, s);
   e2->code(s);
-  // Now $a0 holds a ref to an Int object
-  // This is just the right hand side of plus operation
-  // So we use this object to create a new one as our result
-  s << JAL;
-  emit_method_ref(Object, copy, s);
-  s << endl;
   // lhs: T0, rhs: ACC
   emit_pop(T0, s);
   // lhs: T1, rhs: T2
   emit_fetch_int(T1, T0, s);
   emit_fetch_int(T2, ACC, s);
-  // result in: T3
+  // result in: T1
   op(T1, T1, T2, s);
-  emit_store_int(T1, ACC, s);
+  code_box_int(s);
 }
 
 void plus_class::code(ostream& s) {
@@ -411,16 +435,11 @@ void neg_class::code(ostream& s) {
   CODE_START;
   // Eval the expression
   e1->code(s);
-  // Copy result into new object
-  s << JAL;
-  emit_method_ref(Object, ::copy, s);
-  s << endl;
   // Fetch the value in object
-  emit_fetch_int(T0, ACC, s);
+  emit_fetch_int(T1, ACC, s);
   // Do neg calculation
-  emit_neg(T0, T0, s);
-  // Store result into object
-  emit_store_int(T0, ACC, s);
+  emit_neg(T1, T1, s);
+  code_box_int(s);
   CODE_END;
 }
 
@@ -474,6 +493,16 @@ int leq_class::temporaries() {
 
 void eq_class::code(ostream& s) {
   CODE_START;
+  // String constants are interned in the string table, so two of them
+  // are equal exactly when they are the same entry.
+  if (e1->get_kind() == string_const_kind &&
+      e2->get_kind() == string_const_kind) {
+    auto lhs = static_cast<string_const_class*>(e1)->token;
+    auto rhs = static_cast<string_const_class*>(e2)->token;
+    emit_load_bool(ACC, lhs == rhs ? truebool : falsebool, s);
+    CODE_END;
+    return;
+  }
   auto label = Globals.new_label();
   e1->code(s);
   emit_push(ACC, s);
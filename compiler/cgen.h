@@ -13,6 +13,10 @@ extern enum Memmgr_Test { GC_NORMAL, GC_TEST } cgen_Memmgr_Test;
 
 extern enum Memmgr_Debug { GC_QUICK, GC_DEBUG } cgen_Memmgr_Debug;
 
+extern int cgen_optimize;
+
+extern char* cache_dir;  // -C: cache the code of classes here
+
 
 class BoolConst {
  private:
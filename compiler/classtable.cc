@@ -1,15 +1,16 @@
-#include <typeinfo>
-#include <vector>
 #include <sstream>
+#include <vector>
 #include "cgen.h"
 #include "classtable.h"
+#include "codecache.h"
 #include "emit.h"
 #include "globals.h"
+#include "parallel.h"
+#include "timereport.h"
 
 using std::max;
 using std::pair;
 using std::vector;
-using std::stringstream;
 
 
 extern int cgen_debug;
@@ -27,6 +28,7 @@ ClassTable::ClassTable(Classes classes)
       semant_errors(0),
       error_stream(cerr) {
   if (cgen_debug) { cout << "Building " << __func__ << endl; }
+  PhaseTimer timer("class table");
   enterscope();
 
   install_basic_classes();
@@ -49,6 +51,8 @@ ClassTable::ClassTable(Classes classes)
   build_inheritance_tree();
 
   setup_class_tags();
+
+  layout_classes();
 }
 
 ClassTable::~ClassTable() {
@@ -76,15 +80,31 @@ ostream& ClassTable::semant_error(Class_ c) {
 }
 
 ostream& ClassTable::semant_error(Symbol filename, tree_node* t) {
-  error_stream << filename << ":" << t->get_line_number() << ": ";
-  return semant_error();
+  return semant_error() << filename << ":" << t->get_line_number() << ": ";
+}
+
+namespace {
+thread_local ClassTable::ErrorLog* error_log = NULL;
 }
 
 ostream& ClassTable::semant_error() {
+  if (error_log) {
+    error_log->count++;
+    return error_log->text;
+  }
   semant_errors++;
   return error_stream;
 }
 
+void ClassTable::redirect_errors(ErrorLog* log) {
+  error_log = log;
+}
+
+void ClassTable::merge_errors(ErrorLog& log) {
+  error_stream << log.text.str();
+  semant_errors += log.count;
+}
+
 void ClassTable::check_inheritance() {
   this->AllSymbols.insert(Object);
   this->Graph.SetRoot(Object);
@@ -155,6 +175,44 @@ void ClassTable::setup_class_tags() {
   }
 }
 
+//
+// ClassTable::layout_classes
+//
+// Lay out the objects and dispatch table of every class, starting from
+// a copy of its parent's layout.  Classes are sorted by tag, so parents
+// come first.
+//
+void ClassTable::layout_classes() {
+  for (auto cls: classes_) {
+    auto& layout = cls->layout;
+    auto parent = cls->get_parentnd();
+    if (parent->get_name() != No_class) { layout = parent->layout; }
+    for (auto feature: *cls->features) {
+      if (feature->get_kind() == attr_kind) {
+        auto attr = static_cast<attr_class*>(feature);
+        layout.attr_index.insert(std::make_pair(attr->name, int(layout.attrs.size())));
+        layout.attrs.push_back(attr);
+      } else if (feature->get_kind() == method_kind) {
+        auto method = static_cast<method_class*>(feature);
+        auto found = layout.slot.find(method->name);
+        if (found != layout.slot.end()) {
+          layout.dispatch[found->second] = {cls->name, method};
+        } else {
+          layout.slot[method->name] = layout.dispatch.size();
+          layout.dispatch.push_back({cls->name, method});
+        }
+      }
+    }
+  }
+}
+
+int ClassTable::method_offset(Symbol cls, Symbol method) {
+  auto& slot = probe(cls)->layout.slot;
+  auto found = slot.find(method);
+  assert(found != slot.end());
+  return found->second;
+}
+
 int ClassTable::setup_class_tags_helper(CgenNodeP root, int& index) {
   auto classtag = index++;
   Globals.classtag[root->name] = classtag;
@@ -166,10 +224,13 @@ int ClassTable::setup_class_tags_helper(CgenNodeP root, int& index) {
 }
 
 
-void ClassTable::install_basic_classes() {
+namespace {
+
+// The first basic classes are special, see below
+const size_t kSpecialClasses = 3;
 
-// The tree package uses these globals to annotate the classes built below.
-  //curr_lineno  = 0;
+std::vector<Class_> build_basic_classes() {
+  std::vector<Class_> basic;
   Symbol filename = stringtable.add_string("<basic class>");
 
 //
@@ -180,15 +241,9 @@ void ClassTable::install_basic_classes() {
 // SELF_TYPE is the self class; it cannot be redefined or inherited.
 // prim_slot is a class known to the code generator.
 //
-  addid(No_class,
-        new CgenNode(class_(No_class, No_class, nil_Features(), filename),
-                     Basic, this));
-  addid(SELF_TYPE,
-        new CgenNode(class_(SELF_TYPE, No_class, nil_Features(), filename),
-                     Basic, this));
-  addid(prim_slot,
-        new CgenNode(class_(prim_slot, No_class, nil_Features(), filename),
-                     Basic, this));
+  basic.push_back(class_(No_class, No_class, nil_Features(), filename));
+  basic.push_back(class_(SELF_TYPE, No_class, nil_Features(), filename));
+  basic.push_back(class_(prim_slot, No_class, nil_Features(), filename));
 
 //
 // The Object class has no parent class. Its methods are
@@ -199,17 +254,15 @@ void ClassTable::install_basic_classes() {
 // There is no need for method bodies in the basic classes---these
 // are already built in to the runtime system.
 //
-  install_class(
-      new CgenNode(
-          class_(Object,
-                 No_class,
+  basic.push_back(
+      class_(Object,
+             No_class,
+             append_Features(
                  append_Features(
-                     append_Features(
-                         single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
-                         single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
-                     single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
-                 filename),
-          Basic, this));
+                     single_Features(method(cool_abort, nil_Formals(), Object, no_expr())),
+                     single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
+                 single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
+             filename));
 
 //
 // The IO class inherits from Object. Its methods are
@@ -218,41 +271,35 @@ void ClassTable::install_basic_classes() {
 //        in_string() : Str                    reads a string from the input
 //        in_int() : Int                         "   an int     "  "     "
 //
-  install_class(
-      new CgenNode(
-          class_(IO,
-                 Object,
+  basic.push_back(
+      class_(IO,
+             Object,
+             append_Features(
                  append_Features(
                      append_Features(
-                         append_Features(
-                             single_Features(method(out_string, single_Formals(formal(arg, Str)),
-                                                    SELF_TYPE, no_expr())),
-                             single_Features(method(out_int, single_Formals(formal(arg, Int)),
-                                                    SELF_TYPE, no_expr()))),
-                         single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
-                     single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
-                 filename),
-          Basic, this));
+                         single_Features(method(out_string, single_Formals(formal(arg, Str)),
+                                                SELF_TYPE, no_expr())),
+                         single_Features(method(out_int, single_Formals(formal(arg, Int)),
+                                                SELF_TYPE, no_expr()))),
+                     single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
+                 single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
+             filename));
 
 //
 // The Int class has no methods and only a single attribute, the
 // "val" for the integer.
 //
-  install_class(
-      new CgenNode(
-          class_(Int,
-                 Object,
-                 single_Features(attr(val, prim_slot, no_expr())),
-                 filename),
-          Basic, this));
+  basic.push_back(
+      class_(Int,
+             Object,
+             single_Features(attr(val, prim_slot, no_expr())),
+             filename));
 
 //
 // Bool also has only the "val" slot.
 //
-  install_class(
-      new CgenNode(
-          class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())), filename),
-          Basic, this));
+  basic.push_back(
+      class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())), filename));
 
 //
 // The class Str has a number of slots and operations:
@@ -262,31 +309,53 @@ void ClassTable::install_basic_classes() {
 //       concat(arg: Str) : Str               string concatenation
 //       substr(arg: Int, arg2: Int): Str     substring
 //
-  install_class(
-      new CgenNode(
-          class_(Str,
-                 Object,
+  basic.push_back(
+      class_(Str,
+             Object,
+             append_Features(
                  append_Features(
                      append_Features(
                          append_Features(
-                             append_Features(
-                                 single_Features(attr(val, Int, no_expr())),
-                                 single_Features(attr(str_field, prim_slot, no_expr()))),
-                             single_Features(method(length, nil_Formals(), Int, no_expr()))),
-                         single_Features(method(concat,
-                                                single_Formals(formal(arg, Str)),
-                                                Str,
-                                                no_expr()))),
-                     single_Features(method(substr,
-                                            append_Formals(single_Formals(formal(arg, Int)),
-                                                           single_Formals(formal(arg2, Int))),
+                             single_Features(attr(val, Int, no_expr())),
+                             single_Features(attr(str_field, prim_slot, no_expr()))),
+                         single_Features(method(length, nil_Formals(), Int, no_expr()))),
+                     single_Features(method(concat,
+                                            single_Formals(formal(arg, Str)),
                                             Str,
                                             no_expr()))),
-                 filename),
-          Basic, this));
+                 single_Features(method(substr,
+                                        append_Formals(single_Formals(formal(arg, Int)),
+                                                       single_Formals(formal(arg2, Int))),
+                                        Str,
+                                        no_expr()))),
+             filename));
+  return basic;
+}
 
 }
 
+//
+// The basic classes are the same in every program, so their trees are
+// built once and each table wraps them in nodes of its own.  A compiler
+// server builds them before it forks (see server.cc).
+//
+const std::vector<Class_>& ClassTable::basic_classes() {
+  static std::vector<Class_> basic = build_basic_classes();
+  return basic;
+}
+
+void ClassTable::install_basic_classes() {
+  auto& basic = basic_classes();
+  for (size_t i = 0; i < basic.size(); i++) {
+    auto nd = new CgenNode(basic[i], Basic, this);
+    if (i < kSpecialClasses) {
+      addid(nd->get_name(), nd);
+    } else {
+      install_class(nd);
+    }
+  }
+}
+
 // ClassTable::install_class
 // ClassTable::install_classes
 //
@@ -362,6 +431,7 @@ void CgenNode::set_parentnd(CgenNodeP p) {
 //
 //***************************************************
 void ClassTable::code_global_data(ostream& str) {
+  PhaseTimer timer("code_global_data");
   Symbol main = idtable.lookup_string(MAINNAME);
   Symbol string = idtable.lookup_string(STRINGNAME);
   Symbol integer = idtable.lookup_string(INTNAME);
@@ -412,6 +482,7 @@ void ClassTable::code_global_data(ostream& str) {
 //***************************************************
 
 void ClassTable::code_global_text(ostream& str) {
+  PhaseTimer timer("code_global_text");
   str << GLOBAL << HEAP_START << endl
       << HEAP_START << LABEL
       << WORD << 0 << endl
@@ -435,6 +506,7 @@ void ClassTable::code_bools(int boolclasstag, ostream& str) {
 }
 
 void ClassTable::code_select_gc(ostream& str) {
+  PhaseTimer timer("code_select_gc");
   //
   // Generate GC choice constants (pointers to GC functions)
   //
@@ -464,16 +536,28 @@ void ClassTable::code_select_gc(ostream& str) {
 //********************************************************
 
 void ClassTable::code_constants(ostream& str) {
+  PhaseTimer timer("code_constants");
   // Add constants that are required by the code generator.
-  stringtable.add_string(EMPTY_STR);
-  inttable.add_string(STR_ZERO);
-
-  stringtable.code_string_table(str, stringclasstag);
-  inttable.code_string_table(str, intclasstag);
+  // The empty string, 0 and the class names for type_name go together
+  vector<StringEntry*> hot_strings = {stringtable.add_string(EMPTY_STR)};
+  for (auto cls: classes_) {
+    hot_strings.push_back(stringtable.lookup_string(cls->get_name()->get_string()));
+  }
+  vector<IntEntry*> hot_ints = {inttable.add_string(STR_ZERO)};
+
+  stringtable.label_constants();
+  stringtable.code_string_table(str, stringclasstag, hot_strings);
+  // Every string object below this label is a distinct constant
+  str << GLOBAL << STRCONSTEND << endl
+      << STRCONSTEND << LABEL;
+  stringtable.code_intern_table(str);
+  inttable.code_string_table(str, intclasstag, hot_ints);
+  inttable.code_int_cache(str, intclasstag);
   code_bools(boolclasstag, str);
 }
 
 void ClassTable::code_class_nameTab(ostream& str) {
+  PhaseTimer timer("code_class_nameTab");
   str << CLASSNAMETAB << LABEL;
   for (auto iter: classes_) {
     auto name = iter->get_name()->get_string();
@@ -485,6 +569,7 @@ void ClassTable::code_class_nameTab(ostream& str) {
 }
 
 void ClassTable::code_class_objTab(ostream& str) {
+  PhaseTimer timer("code_class_objTab");
   str << CLASSOBJTAB << LABEL;
   for (auto iter: classes_) {
     auto cls_name = iter->get_name()->get_string();
@@ -493,110 +578,43 @@ void ClassTable::code_class_objTab(ostream& str) {
   }
 }
 
-static int
-code_proto_object_helper(CgenNodeP cls, ostream& s) {
-  auto parent = cls->get_parentnd();
-  // If this node have a parent
-  // then it is just the Object class
-  int size = DEFAULT_OBJFIELDS;
-  if (parent->get_name() != No_class) {
-    size = code_proto_object_helper(parent, s);
-  }
-  auto features = cls->features;
-  for (auto i = features->first();
-       features->more(i);
-       i = features->next(i)) {
-    auto cur_feature = features->nth(i);
-    if (typeid(*cur_feature) == typeid(attr_class)) {
-      size++;
-      auto attr = static_cast<attr_class*>(cur_feature);
-      s << WORD;
-      if (attr->type_decl == Int) {
-        inttable.lookup_string(STR_ZERO)->code_ref(s);
-      } else if (attr->type_decl == Bool) {
-        falsebool.code_ref(s);
-      } else if (attr->type_decl == Str) {
-        stringtable.lookup_string(EMPTY_STR)->code_ref(s);
-      } else {
-        s << STR_ZERO;
-      }
-      s << endl;
-    }
-  }
-  return size;
-}
-
 void ClassTable::code_proto_object(ostream& str) {
+  PhaseTimer timer("code_proto_object");
   int idx = 0;
   for (auto cls: classes_) {
-    stringstream ss;
     auto cls_name = cls->get_name()->get_string();
-    auto size = code_proto_object_helper(cls, ss);
+    auto& attrs = cls->layout.attrs;
     str << WORD << "-1" << endl                       // -1 eye catcher
         << cls_name << PROTOBJ_SUFFIX << LABEL        // class label
         << WORD << idx << endl                        // class tag
-        << WORD << size << endl                       // object size
-        << WORD << cls_name << DISPTAB_SUFFIX << endl // dispatch table
-        << ss.str();                                  // data attributes
-    idx++;
-  }
-}
-
-static void
-code_dispatch_table_helper(Symbol class_name,
-                           CgenNodeP cur,
-                           vector<pair<Symbol, Symbol>>& disp_table) {
-  auto parent = cur->get_parentnd();
-  // If this node have a parent
-  if (parent->get_name() != No_class) {
-    code_dispatch_table_helper(class_name, parent, disp_table);
-  }
-  auto features = cur->features;
-  for (auto i = features->first();
-       features->more(i);
-       i = features->next(i)) {
-    auto cur_feature = features->nth(i);
-    // if this feature is a method
-    // then we add it into dispatch table
-    if (typeid(*cur_feature) == typeid(method_class)) {
-      auto method_name = static_cast<method_class*>(cur_feature)->name;
-      int offset = -1;
-      auto pair = std::make_pair(cur->get_name(), method_name);
-      // We should first check if method with same name
-      // already exists in the dispatch table
-      // which means that this method is overwritten by its sub class
-      for (int i = 0; i < disp_table.size(); i++) {
-        auto& item = disp_table[i];
-        if (item.second == method_name) {
-          item = pair;
-          offset = i;
-          break;
-        }
-      }
-      // If not found, then we append this method
-      // at the end of dispatch table
-      if (offset == -1) {
-        disp_table.push_back(pair);
-        offset = int(disp_table.size()) - 1;
+        << WORD << DEFAULT_OBJFIELDS + attrs.size() << endl // object size
+        << WORD << cls_name << DISPTAB_SUFFIX << endl; // dispatch table
+    // data attributes
+    for (auto attr: attrs) {
+      str << WORD;
+      if (attr->type_decl == Int) {
+        inttable.lookup_string(STR_ZERO)->code_ref(str);
+      } else if (attr->type_decl == Bool) {
+        falsebool.code_ref(str);
+      } else if (attr->type_decl == Str) {
+        stringtable.lookup_string(EMPTY_STR)->code_ref(str);
+      } else {
+        str << STR_ZERO;
       }
-      // This is used to record methods of the class
-      // So this parameter "class_name" is unchanged
-      Globals.set_method_offset_for_class(
-          class_name, method_name, offset);
+      str << endl;
     }
+    idx++;
   }
 }
 
 void ClassTable::code_dispatch_table(ostream& str) {
-  vector<pair<Symbol, Symbol>> disp_table;
+  PhaseTimer timer("code_dispatch_table");
   for (auto cls: classes_) {
     str << cls->get_name() << DISPTAB_SUFFIX << LABEL;
-    // Notice that we pass the name of current class in
-    code_dispatch_table_helper(cls->get_name(), cls, disp_table);
-    for (auto& item: disp_table) {
+    for (auto& item: cls->layout.dispatch) {
       str << WORD;
       // We use this name to ref the absolute code address of a method
-      emit_method_ref(item.first, item.second, str);
+      emit_method_ref(item.cls, item.method->name, str);
       str << endl;
     }
   }
@@ -626,140 +644,189 @@ method_call_on_return(int num_temp,
   emit_return(s);
 }
 
-static void load_attr_for_class(CgenNodeP cls, int& offset) {
-  auto parent = cls->get_parentnd();
-  // If this node have a parent
-  if (parent->get_name() != No_class) {
-    load_attr_for_class(parent, offset);
+// Bind the attributes of cls to their words in self
+static void load_attr_for_class(CgenNodeP cls) {
+  auto& attrs = cls->layout.attrs;
+  for (int i = 0; i < attrs.size(); i++) {
+    Globals.env.addid(attrs[i]->name,
+                      Globals.new_location(SELF, DEFAULT_OBJFIELDS + i));
   }
+}
+
+void ClassTable::code_object_initializer(CgenNodeP cls, ostream& str) {
+  PhaseTimer timer("code_object_initializer");
+  Globals.set_current_class(cls->get_name());
+  Globals.env.enterscope();
 
+  load_attr_for_class(cls);
+
+  // First pass:
+  // calculate number of temp locations
+  int max_temp = 0;
   auto features = cls->features;
   for (int i = features->first();
        features->more(i);
        i = features->next(i)) {
     auto feature = features->nth(i);
-    if (typeid(*feature) == typeid(attr_class)) {
+    if (feature->get_kind() == attr_kind) {
       auto attr = static_cast<attr_class*>(feature);
-      Globals.env.addid(attr->name,
-                        Globals.new_location(SELF, offset++));
+      max_temp = max(max_temp, attr->init->temporaries());
     }
   }
-}
-
-void ClassTable::code_object_initializer(ostream& str) {
-  for (auto cls: classes_) {
-    Globals.set_current_class(cls->get_name());
-    Globals.env.enterscope();
-
-    int offset = DEFAULT_OBJFIELDS;
-    load_attr_for_class(cls, offset);
-
-    // First pass:
-    // calculate number of temp locations
-    int max_temp = 0;
-    auto features = cls->features;
-    for (int i = features->first();
-         features->more(i);
-         i = features->next(i)) {
-      auto feature = features->nth(i);
-      if (typeid(*feature) == typeid(attr_class)) {
-        auto attr = static_cast<attr_class*>(feature);
-        max_temp = max(max_temp, attr->init->temporaries());
-      }
-    }
 
-    Globals.init_temp_allocator(max_temp);
+  Globals.init_temp_allocator(max_temp);
 
-    str << cls->get_name() << CLASSINIT_SUFFIX << LABEL;
-    method_call_on_init(max_temp, str);
+  str << cls->get_name() << CLASSINIT_SUFFIX << LABEL;
+  method_call_on_init(max_temp, str);
 
-    auto parent = cls->get_parentnd();
-    // If this node have a parent
-    // then we first call <parent>_init
-    if (parent->get_name() != No_class) {
-      str << JAL;
-      emit_init_ref(parent->get_name(), str);
-      str << endl;
-    }
+  auto parent = cls->get_parentnd();
+  // If this node have a parent
+  // then we first call <parent>_init
+  if (parent->get_name() != No_class) {
+    str << JAL;
+    emit_init_ref(parent->get_name(), str);
+    str << endl;
+  }
 
-    // Second pass: generate code to initialize attributes
-    for (auto i = features->first();
-         features->more(i);
-         i = features->next(i)) {
-      auto feature = features->nth(i);
-      if (typeid(*feature) == typeid(attr_class)) {
-        auto attr = static_cast<attr_class*>(feature);
-        // Generate code for init expr
-        // As for no_expr, it returns nothing
-        // But we still need to check type here
-        if (typeid(*attr->init) != typeid(no_expr_class)) {
-          attr->init->code(str);
-          // Now the result of this expr stores in $a0
-          // we move it into the location of this attr
-          auto loc = Globals.env.lookup(attr->name);
-          assert(loc != nullptr);
-          emit_store(ACC, loc->offset, loc->reg, str);
-        }
+  // Second pass: generate code to initialize attributes
+  for (auto i = features->first();
+       features->more(i);
+       i = features->next(i)) {
+    auto feature = features->nth(i);
+    if (feature->get_kind() == attr_kind) {
+      auto attr = static_cast<attr_class*>(feature);
+      // Generate code for init expr
+      // As for no_expr, it returns nothing
+      // But we still need to check type here
+      if (attr->init->get_kind() != no_expr_kind) {
+        attr->init->code(str);
+        // Now the result of this expr stores in $a0
+        // we move it into the location of this attr
+        auto loc = Globals.env.lookup(attr->name);
+        assert(loc != nullptr);
+        emit_store(ACC, loc->offset, loc->reg, str);
       }
     }
-    // We copy self pointer back
-    // to ensure that $a0 is unmodified
-    // But this is only for <class>_init
-    emit_move(ACC, SELF, str);
-    method_call_on_return(max_temp, 0, str);
-
-    Globals.env.exitscope();
   }
+  // We copy self pointer back
+  // to ensure that $a0 is unmodified
+  // But this is only for <class>_init
+  emit_move(ACC, SELF, str);
+  method_call_on_return(max_temp, 0, str);
+
+  Globals.env.exitscope();
 }
 
-void ClassTable::code_class_methods(ostream& str) {
-  for (auto cls: classes_) {
-    if (cls->basic()) { continue; }
-    Globals.set_current_class(cls->get_name());
-    Globals.env.enterscope();
-
-    int offset = DEFAULT_OBJFIELDS;
-    load_attr_for_class(cls, offset);
-
-    auto features = cls->features;
-    for (int i = features->first();
-         features->more(i);
-         i = features->next(i)) {
-      auto feature = features->nth(i);
-      if (typeid(*feature) == typeid(method_class)) {
-        auto method = static_cast<method_class*>(feature);
-        Globals.env.enterscope();
-
-        // Add formal parameters into env
-        // Notice how do we calculate offset here
-        auto formals = method->formals;
-        for (int k = formals->first(),
-                 arg_offset = SAVED_REGS + formals->len() - 1;
-             formals->more(k);
-             k = formals->next(k), arg_offset--) {
-          auto formal = static_cast<formal_class*>(formals->nth(k));
-          Globals.env.addid(formal->name,
-                            Globals.new_location(FP, arg_offset));
-        }
+void ClassTable::code_class_methods(CgenNodeP cls, ostream& str) {
+  PhaseTimer timer("code_class_methods");
+  Globals.set_current_class(cls->get_name());
+  Globals.env.enterscope();
+
+  load_attr_for_class(cls);
 
-        int max_temp = method->expr->temporaries();
-        Globals.init_temp_allocator(max_temp);
+  auto features = cls->features;
+  for (int i = features->first();
+       features->more(i);
+       i = features->next(i)) {
+    auto feature = features->nth(i);
+    if (feature->get_kind() == method_kind) {
+      auto method = static_cast<method_class*>(feature);
+      Globals.env.enterscope();
+
+      // Add formal parameters into env
+      // Notice how do we calculate offset here
+      auto formals = method->formals;
+      for (int k = formals->first(),
+               arg_offset = SAVED_REGS + formals->len() - 1;
+           formals->more(k);
+           k = formals->next(k), arg_offset--) {
+        auto formal = static_cast<formal_class*>(formals->nth(k));
+        Globals.env.addid(formal->name,
+                          Globals.new_location(FP, arg_offset));
+      }
+
+      int max_temp = method->expr->temporaries();
+      Globals.init_temp_allocator(max_temp);
+
+      emit_method_ref(cls->get_name(), method->name, str);
+      str << LABEL;
+      method_call_on_init(max_temp, str);
+      method->expr->code(str);
+      method_call_on_return(max_temp, formals->len(), str);
 
-        emit_method_ref(cls->get_name(), method->name, str);
-        str << LABEL;
-        method_call_on_init(max_temp, str);
-        method->expr->code(str);
-        method_call_on_return(max_temp, formals->len(), str);
+      Globals.env.exitscope();
+    }
+  }
 
-        Globals.env.exitscope();
+  Globals.env.exitscope();
+}
+
+// Each class is coded on its own into buffers of its own, on a pool of
+// threads; the buffers are written out in class order, all initializers
+// before all methods, as if coded one class after another.  With -C the
+// code of a class whose fingerprint is unchanged comes from the cache.
+void ClassTable::code_classes(ostream& str, const CodeUnits& units) {
+  PhaseTimer timer("code_classes");
+  vector<CgenNodeP> classes(classes_.begin(), classes_.end());
+  vector<std::string> inits(classes.size());
+  vector<std::string> methods(classes.size());
+  std::unique_ptr<CodeCache> cache;
+  if (cache_dir) { cache.reset(new CodeCache(cache_dir)); }
+  auto phase = PhaseTimer::current();
+  parallel_for(classes.size(), [&](int i) {
+    PhaseWorker worker(phase);
+    auto cls = classes[i];
+    std::string key;
+    if (cache) {
+      key = class_fingerprint(cls);
+      if (cache->load(key, inits[i], methods[i])) { return; }
+    }
+    std::ostringstream init_code, method_code;
+    Globals.enter_label_space(Globals.classtag.at(cls->get_name()));
+    code_object_initializer(cls, init_code);
+    if (!cls->basic()) { code_class_methods(cls, method_code); }
+    inits[i] = init_code.str();
+    methods[i] = method_code.str();
+    if (cache) { cache->store(key, inits[i], methods[i]); }
+  });
+  // The classes of files with units of their own go there instead
+  auto out = [&](CgenNodeP cls) -> ostream& {
+    auto unit = units.find(cls->get_filename());
+    return unit == units.end() ? str : *unit->second;
+  };
+  // and name their initializers and methods global, for the other files
+  if (!units.empty()) {
+    for (auto cls: classes) {
+      out(cls) << GLOBAL;
+      emit_init_ref(cls->get_name(), out(cls));
+      out(cls) << endl;
+      if (cls->basic()) { continue; }
+      for (auto feature: *cls->features) {
+        if (feature->get_kind() != method_kind) { continue; }
+        out(cls) << GLOBAL;
+        emit_method_ref(cls->get_name(), static_cast<method_class*>(feature)->name, out(cls));
+        out(cls) << endl;
       }
     }
+  }
+  for (size_t i = 0; i < classes.size(); i++) { out(classes[i]) << inits[i]; }
+  for (size_t i = 0; i < classes.size(); i++) { out(classes[i]) << methods[i]; }
+}
 
-    Globals.env.exitscope();
+// With -u the units refer to the constants, tables and prototype objects
+// of the -o file, and they all go through spim's loader one file at a
+// time, which keeps a label to its file unless it is declared global
+void ClassTable::code_unit_globals(ostream& str) {
+  stringtable.code_globals(str);
+  inttable.code_globals(str);
+  str << GLOBAL << CLASSOBJTAB << endl;
+  for (auto cls: classes_) {
+    str << GLOBAL << cls->get_name() << PROTOBJ_SUFFIX << endl
+        << GLOBAL << cls->get_name() << DISPTAB_SUFFIX << endl;
   }
 }
 
-void ClassTable::code(ostream& s) {
+void ClassTable::code(ostream& s, const CodeUnits& units) {
   if (cgen_debug) { cout << "coding global data" << endl; }
   code_global_data(s);
 
@@ -784,11 +851,14 @@ void ClassTable::code(ostream& s) {
   if (cgen_debug) { cout << "coding global text" << endl; }
   code_global_text(s);
 
-  if (cgen_debug) { cout << "coding object initializer" << endl; }
-  code_object_initializer(s);
+  if (!units.empty()) { code_unit_globals(s); }
 
-  if (cgen_debug) { cout << "coding class methods" << endl; }
-  code_class_methods(s);
+  if (cgen_debug) { cout << "coding object initializers and class methods" << endl; }
+  for (auto& unit: units) {
+    *unit.second << "# classes of " << unit.first << "\n"
+                 << "\t.text\n";
+  }
+  code_classes(s, units);
 }
 
 CgenNodeP ClassTable::root() {
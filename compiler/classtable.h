@@ -5,12 +5,15 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <sstream>
 #include "cool-tree.h"
 #include "symtab.h"
 
 using std::set;
 using std::map;
 using std::vector;
+using std::pair;
 
 class CgenNode;
 
@@ -25,6 +28,22 @@ enum Basicness {
 };
 
 
+// Where attributes and methods are in the objects and the dispatch
+// table of a class, computed once for all classes by layout_classes
+struct ClassLayout {
+  struct Slot {
+    Symbol cls;             // the class defining the method
+    method_class* method;
+  };
+  // attribute i is word DEFAULT_OBJFIELDS + i, inherited ones first
+  vector<attr_class*> attrs;
+  std::unordered_map<Symbol, int> attr_index;
+  // the dispatch table; a method overriding another takes its slot
+  vector<Slot> dispatch;
+  std::unordered_map<Symbol, int> slot;
+};
+
+
 class CgenNode : public class__class {
  private:
   CgenNodeP parentnd;                        // Parent of class
@@ -46,9 +65,15 @@ class CgenNode : public class__class {
   CgenNodeP get_parentnd() { return parentnd; }
 
   int basic() { return (basic_status == Basic); }
+
+  ClassLayout layout;
 };
 
 
+// The class hierarchy.  Elem is a string table entry: nodes are found
+// through get_index().  Once CheckCircle has found the graph to be a
+// tree, every node has DFS entry and exit numbers, so ConformTo takes
+// constant time, and ancestors 2^k levels up for LCA in O(log n).
 template<typename Elem>
 class InheritanceGraph {
  public:
@@ -60,101 +85,74 @@ class InheritanceGraph {
   }
 
   void AddNode(Elem p) {
-    vector<int> emptyVec;
+    auto i = p->get_index();
+    if (i >= (int) NodeOf.size()) { NodeOf.resize(i + 1, -1); }
+    NodeOf[i] = this->Nodes.size();
     this->Nodes.push_back(p);
-    pElem2Idx[p] = this->Nodes.size() - 1;
     EdgeUp.push_back(this->Nodes.size() - 1);
-    EdgeDown.push_back(emptyVec);
+    EdgeDown.push_back(vector<int>());
   };
 
   bool AddEdge(Elem father, Elem son) {
-    if (this->pElem2Idx.find(father) == this->pElem2Idx.end() ||
-        this->pElem2Idx.find(son) == this->pElem2Idx.end()) {
+    if (this->Find(father) < 0 || this->Find(son) < 0) {
       return false;
     }
-    auto u = this->pElem2Idx[father];
-    auto v = this->pElem2Idx[son];
+    auto u = this->Find(father);
+    auto v = this->Find(son);
     this->EdgeDown[u].push_back(v);
     this->EdgeUp[v] = u;
     return true;
   };
 
   bool CheckCircle() {
-    // Check if all nodes are from a root node
-    // Check if there is circle in Inheritance Nodes
-    vector<bool> flags;
-    flags.resize(Nodes.size());
-    for (auto i = 0; i < this->Nodes.size(); i++) {
-      auto u = i;
-      fill(flags.begin(), flags.end(), false);
-      while (u != 0 && u != this->EdgeUp[u] && !flags[this->EdgeUp[u]]) {
-        u = this->EdgeUp[u];
-        flags[u] = true;
+    // Every node has one parent, so there is no circle if and only if
+    // all nodes are reached from the root.  Number them on the way.
+    int n = Nodes.size();
+    Enter.assign(n, -1);
+    Exit.assign(n, -1);
+    int clock = 0;
+    vector<pair<int, size_t>> stack = {{0, 0}};
+    Enter[0] = clock++;
+    while (!stack.empty()) {
+      auto& top = stack.back();
+      if (top.second < EdgeDown[top.first].size()) {
+        int v = EdgeDown[top.first][top.second++];
+        Enter[v] = clock++;
+        stack.push_back({v, 0});
+      } else {
+        Exit[top.first] = clock++;
+        stack.pop_back();
       }
-      if (u != 0) { return false; }
     }
-    size_t sum_edges = 0;
-    for (auto i = 0; i < this->EdgeDown.size(); i++) {
-      sum_edges += this->EdgeDown[i].size();
+    if (clock != 2 * n) { return false; }
+    // Up[k][u] is the ancestor of u 2^k levels up, or the root
+    Up.assign(1, EdgeUp);
+    Up[0][0] = 0;
+    for (int k = 1; (1 << k) < n; k++) {
+      Up.push_back(vector<int>(n));
+      for (int u = 0; u < n; u++) {
+        Up[k][u] = Up[k - 1][Up[k - 1][u]];
+      }
     }
-    return sum_edges == this->Nodes.size() - 1;
+    return true;
   };
 
   Elem LCA(Elem a, Elem b) {
-    auto u = this->pElem2Idx[a];
-    auto v = this->pElem2Idx[b];
-    int len1 = 0, len2 = 0;
-    while (u != 0) {
-      u = EdgeUp[u];
-      len1++;
+    auto u = this->Index(a);
+    auto v = this->Index(b);
+    if (this->IsAncestor(u, v)) { return this->Nodes[u]; }
+    if (this->IsAncestor(v, u)) { return this->Nodes[v]; }
+    // Climb from u to the highest ancestor that is not above v
+    for (int k = Up.size() - 1; k >= 0; k--) {
+      if (!this->IsAncestor(Up[k][u], v)) { u = Up[k][u]; }
     }
-    while (v != 0) {
-      v = EdgeUp[v];
-      len2++;
-    }
-    u = this->pElem2Idx[a];
-    v = this->pElem2Idx[b];
-    if (len1 > len2) {
-      int n = len1 - len2;
-      while (n--) { u = EdgeUp[u]; }
-    } else if (len1 < len2) {
-      int n = len2 - len1;
-      while (n--) { v = EdgeUp[v]; }
-    }
-    while (u != v) {
-      u = EdgeUp[u];
-      v = EdgeUp[v];
-    }
-    return this->Nodes[u];
-  };
-
-  // Seems that this method is useless
-  int compare(Elem a, Elem b) {
-    auto u = this->pElem2Idx[a];
-    auto v = this->pElem2Idx[b];
-    while (u != 0) {
-      u = EdgeUp[u];
-      if (u == v) { return -1; }
-    }
-    u = this->pElem2Idx[a];
-    while (v != 0) {
-      v = EdgeUp[v];
-      if (u == v) { return 1; }
-    }
-    return 0;
+    return this->Nodes[EdgeUp[u]];
   };
 
   bool ConformTo(Elem a, Elem b) {
     if (this->SonOfAll.find(a) != this->SonOfAll.end()) { return true; }
     if (this->SonOfAll.find(b) != this->SonOfAll.end()) { return false; }
-    auto u = this->pElem2Idx[a];
-    auto v = this->pElem2Idx[b];
-    if (v == 0) { return true; }
-    while (u != 0) {
-      if (u == v) { return true; }
-      u = EdgeUp[u];
-    }
-    return false;
+    return this->IsAncestor(this->Index(b), this->Index(a));
   };
 
   vector<Elem>* get_leaves() {
@@ -166,7 +164,7 @@ class InheritanceGraph {
   };
 
   Elem get_father(Elem son) {
-    return this->Nodes[this->EdgeUp[this->pElem2Idx[son]]];
+    return this->Nodes[this->EdgeUp[this->Index(son)]];
   };
 
   void AddSon(Elem son) {
@@ -174,7 +172,7 @@ class InheritanceGraph {
   }
 
   bool is_leave(Elem node) {
-    return this->EdgeDown[this->pElem2Idx[node]].size() == 0;
+    return this->EdgeDown[this->Index(node)].size() == 0;
   }
 
  private:
@@ -182,14 +180,32 @@ class InheritanceGraph {
     this->Nodes.clear();
     this->EdgeDown.clear();
     this->EdgeUp.clear();
-    this->pElem2Idx.clear();
+    this->NodeOf.clear();
     this->SonOfAll.clear();
   }
 
+  // The node of p, or -1
+  int Find(Elem p) {
+    auto i = p->get_index();
+    return i < (int) NodeOf.size() ? NodeOf[i] : -1;
+  }
+
+  // The node of p; classes not in the graph stand for the root
+  int Index(Elem p) {
+    auto u = this->Find(p);
+    return u < 0 ? 0 : u;
+  }
+
+  bool IsAncestor(int u, int v) {
+    return Enter[u] <= Enter[v] && Exit[v] <= Exit[u];
+  }
+
   vector<Elem> Nodes;
   vector<vector<int>> EdgeDown;
   vector<int> EdgeUp;
-  map<Elem, int> pElem2Idx;
+  vector<int> NodeOf;       // node of each string table index, or -1
+  vector<int> Enter, Exit;  // DFS numbering
+  vector<vector<int>> Up;
   set<Elem> SonOfAll;
 };
 
@@ -203,10 +219,16 @@ class ClassTable : public SymbolTable<Symbol, CgenNodeP> {
 
   ~ClassTable();
 
-  void code(ostream& s);
+  void code(ostream& s, const CodeUnits& units);
 
   CgenNodeP root();
 
+  // Dispatch table slot of method in class cls
+  int method_offset(Symbol cls, Symbol method);
+
+  // The trees of the basic classes, shared by every table
+  static const vector<Class_>& basic_classes();
+
  private:
   std::list<CgenNodeP> classes_;
 
@@ -235,9 +257,13 @@ class ClassTable : public SymbolTable<Symbol, CgenNodeP> {
 
   void code_dispatch_table(ostream&);
 
-  void code_object_initializer(ostream&);
+  void code_object_initializer(CgenNodeP, ostream&);
 
-  void code_class_methods(ostream&);
+  void code_class_methods(CgenNodeP, ostream&);
+
+  void code_classes(ostream&, const CodeUnits& units);
+
+  void code_unit_globals(ostream&);
 
 // The following creates an inheritance graph from
 // a list of classes.  The graph is implemented as
@@ -261,12 +287,27 @@ class ClassTable : public SymbolTable<Symbol, CgenNodeP> {
 
   int setup_class_tags_helper(CgenNodeP root, int& index);
 
+  void layout_classes();
+
   //
   // Methods for semant
   //
  public:
   int errors() { return semant_errors; }
 
+  // The errors of one class, kept apart while classes are type checked
+  // in parallel and then passed to merge_errors in source order
+  struct ErrorLog {
+    std::ostringstream text;
+    int count = 0;
+  };
+
+  // Send the errors reported on this thread to log, or to the error
+  // stream again if log is NULL
+  static void redirect_errors(ErrorLog* log);
+
+  void merge_errors(ErrorLog& log);
+
   ostream& semant_error();
 
   ostream& semant_error(Class_ c);
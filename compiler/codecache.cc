@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include "cgen.h"
+#include "codecache.h"
+#include "emit.h"
+#include "globals.h"
+
+extern ClassTable* classtable;
+
+namespace {
+
+// Bump when the code generated for the same fingerprint changes
+const int kCacheVersion = 1;
+
+// Writes a class into its fingerprint, node by node
+struct Fingerprint {
+  std::string& key;
+  CgenNodeP cls;
+
+  void put(int n) {
+    key += std::to_string(n);
+    key += ' ';
+  }
+
+  void put(Symbol s) {
+    if (s) {
+      key += s->get_string();
+    } else {
+      key += '-';
+    }
+    key += ' ';
+  }
+
+  // The label of a string constant, which its code loads
+  void put(StringEntry* e) {
+    std::ostringstream label;
+    e->code_ref(label);
+    key += label.str();
+    key += ' ';
+  }
+
+  void put(Expression e) {
+    put(e->get_kind());
+    put(e->get_type());
+    visit(e, *this);
+    key += '\n';
+  }
+
+  void put(Expressions list) {
+    put(list->len());
+    for (auto e: *list) { put(e); }
+  }
+
+  void operator()(method_class* m) {
+    put(m->name);
+    put(m->return_type);
+    put(m->formals->len());
+    for (auto f: *m->formals) {
+      put(static_cast<formal_class*>(f)->name);
+      put(static_cast<formal_class*>(f)->type_decl);
+    }
+    put(m->expr);
+  }
+
+  void operator()(attr_class* a) {
+    put(a->name);
+    put(a->type_decl);
+    put(a->init);
+  }
+
+  void operator()(assign_class* e) {
+    put(e->name);
+    put(e->expr);
+  }
+
+  void operator()(static_dispatch_class* e) {
+    put(e->expr);
+    put(e->type_name);
+    put(e->name);
+    put(classtable->method_offset(e->type_name, e->name));
+    put(e->actual);
+  }
+
+  void operator()(dispatch_class* e) {
+    put(e->expr);
+    put(e->name);
+    auto obj_type = e->expr->get_type();
+    if (obj_type == SELF_TYPE) { obj_type = cls->get_name(); }
+    put(classtable->method_offset(obj_type, e->name));
+    put(e->actual);
+  }
+
+  void operator()(cond_class* e) {
+    put(e->pred);
+    put(e->then_exp);
+    put(e->else_exp);
+  }
+
+  void operator()(loop_class* e) {
+    put(e->pred);
+    put(e->body);
+  }
+
+  void operator()(typcase_class* e) {
+    // The only line number in the code, so edits that move a class
+    // leave its fingerprint alone
+    put(e->get_line_number());
+    put(e->expr);
+    put(e->cases->len());
+    for (auto c: *e->cases) {
+      auto branch = static_cast<branch_class*>(c);
+      put(branch->name);
+      put(branch->type_decl);
+      put(Globals.classtag.at(branch->type_decl));
+      put(Globals.subclasstag_max.at(branch->type_decl));
+      put(branch->expr);
+    }
+  }
+
+  void operator()(block_class* e) {
+    put(e->body);
+  }
+
+  void operator()(let_class* e) {
+    put(e->identifier);
+    put(e->type_decl);
+    put(e->init);
+    put(e->body);
+  }
+
+#define BINARY_FINGERPRINT(name) \
+  void operator()(name##_class* e) { put(e->e1); put(e->e2); }
+  BINARY_FINGERPRINT(plus)
+  BINARY_FINGERPRINT(sub)
+  BINARY_FINGERPRINT(mul)
+  BINARY_FINGERPRINT(divide)
+  BINARY_FINGERPRINT(lt)
+  BINARY_FINGERPRINT(eq)
+  BINARY_FINGERPRINT(leq)
+#undef BINARY_FINGERPRINT
+
+  void operator()(neg_class* e) { put(e->e1); }
+
+  void operator()(comp_class* e) { put(e->e1); }
+
+  void operator()(isvoid_class* e) { put(e->e1); }
+
+  // Int constants are named after their digits
+  void operator()(int_const_class* e) { put(e->token); }
+
+  void operator()(string_const_class* e) {
+    put(stringtable.lookup_string(e->token->get_string()));
+  }
+
+  void operator()(bool_const_class* e) { put(e->val); }
+
+  void operator()(new__class* e) { put(e->type_name); }
+
+  void operator()(object_class* e) { put(e->name); }
+
+  void operator()(tree_node*) {}
+};
+
+// FNV-1a
+unsigned long long hash(const std::string& s) {
+  unsigned long long h = 14695981039346656037ULL;
+  for (unsigned char c: s) {
+    h = (h ^ c) * 1099511628211ULL;
+  }
+  return h;
+}
+
+}
+
+std::string class_fingerprint(CgenNodeP cls) {
+  std::string key;
+  Fingerprint f = {key, cls};
+  f.put(kCacheVersion);
+  f.put(cgen_optimize);
+  f.put(cgen_Memmgr);
+  f.put(cgen_Memmgr_Test);
+  f.put(cgen_Memmgr_Debug);
+  f.put(cgen_debug);  // -c traces the code of each method
+  // Constants every class may load
+  f.put(stringtable.lookup_string(cls->get_filename()->get_string()));
+  f.put(stringtable.lookup_string(EMPTY_STR));
+
+  f.put(cls->get_name());
+  f.put(Globals.classtag.at(cls->get_name()));
+  f.put(cls->get_parentnd()->get_name());
+  auto& layout = cls->layout;
+  f.put(layout.attrs.size());
+  for (auto attr: layout.attrs) {
+    f.put(attr->name);
+    f.put(attr->type_decl);
+  }
+  f.put(layout.dispatch.size());
+  for (auto& slot: layout.dispatch) {
+    f.put(slot.cls);
+    f.put(slot.method->name);
+  }
+  f.put(cls->features->len());
+  for (auto feature: *cls->features) {
+    f.put(feature->get_kind());
+    visit(feature, f);
+  }
+  return key;
+}
+
+CodeCache::CodeCache(const char* dir) : dir_(dir) {
+  mkdir(dir, 0777);
+}
+
+std::string CodeCache::path(const std::string& key) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.s", hash(key));
+  return dir_ + name;
+}
+
+// A cache file holds a line with the sizes of the key, the initializer
+// and the methods, then the three of them
+bool CodeCache::load(const std::string& key, std::string& init, std::string& methods) {
+  std::ifstream in(path(key), std::ios::binary);
+  size_t key_size, init_size, methods_size;
+  if (!(in >> key_size >> init_size >> methods_size) || in.get() != '\n' ||
+      key_size != key.size()) {
+    return false;
+  }
+  std::string text(key_size + init_size + methods_size, '\0');
+  if (!in.read(&text[0], text.size()) || text.compare(0, key_size, key) != 0) {
+    return false;
+  }
+  init = text.substr(key_size, init_size);
+  methods = text.substr(key_size + init_size);
+  return true;
+}
+
+// Written to a temporary file first, so that compilers sharing the
+// cache never read a partial file
+void CodeCache::store(const std::string& key, const std::string& init,
+                      const std::string& methods) {
+  auto file = path(key);
+  auto temp = file + "." + std::to_string(getpid());
+  {
+    std::ofstream out(temp, std::ios::binary);
+    out << key.size() << " " << init.size() << " " << methods.size() << "\n"
+        << key << init << methods;
+    if (!out) {
+      unlink(temp.c_str());
+      return;
+    }
+  }
+  if (rename(temp.c_str(), file.c_str()) != 0) { unlink(temp.c_str()); }
+}
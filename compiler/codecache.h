@@ -0,0 +1,36 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+//
+// Incremental code generation.  The code of each class (its initializer
+// and its methods) is saved in a cache directory under a fingerprint of
+// everything it was generated from, and reused while that is unchanged.
+//
+
+#include <string>
+#include "classtable.h"
+
+// The fingerprint of the code of cls: its AST with types, its layout
+// (and so that of its ancestors), the dispatch offsets of the methods it
+// calls, the tags of the classes its cases test and the labels of the
+// constants it loads.  A change to another class only changes it if cls
+// depends on what changed.
+std::string class_fingerprint(CgenNodeP cls);
+
+class CodeCache {
+ public:
+  explicit CodeCache(const char* dir);
+
+  // The code saved under fingerprint key, if any
+  bool load(const std::string& key, std::string& init, std::string& methods);
+
+  void store(const std::string& key, const std::string& init,
+             const std::string& methods);
+
+ private:
+  std::string path(const std::string& key);
+
+  std::string dir_;
+};
+
+#endif
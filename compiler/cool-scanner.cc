@@ -0,0 +1,305 @@
+//
+// A hand-written scanner for Cool, an alternative to the one flex builds
+// from cool.flex (see COOL_HAND_LEXER in CMakeLists.txt).  It produces
+// the same tokens, errors and line numbers.
+//
+// The whole source is scanned in one buffer ending in two null bytes:
+// the mapped file from cool_yy_scan_source, or else the contents of fin.
+// The null bytes stop every loop that does not look for null characters
+// anyway, so only strings and comments check for the end of the buffer.
+// Keywords are recognized with a perfect hash of their length and three
+// of their characters, checked at compile time.  All of the state is
+// per thread, so that each thread can scan a file of its own.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "cool.h"
+#include "cool-parse.h"
+#include "stringtab.h"
+#include "utilities.h"
+
+using std::vector;
+
+// Max size of string constants
+#define MAX_STR_CONST 1025
+
+extern FILE* fin;   // we read from this file if it is not mapped
+extern thread_local int curr_lineno;
+extern thread_local YYSTYPE cool_yylval;
+
+namespace {
+
+thread_local const char* buf_begin = nullptr;
+thread_local const char* buf_end = nullptr;    // the first of the two null bytes
+thread_local const char* cur = nullptr;
+thread_local vector<char> contents;            // fin read into memory
+
+thread_local bool skip_string = false;         // skip the rest of a bad string constant
+thread_local char string_buf[MAX_STR_CONST];   // to assemble string constants
+thread_local char error_char[2];
+
+#define RET_ERROR(s) { cool_yylval.error_msg = (s); return ERROR; }
+
+void read_fin() {
+  char chunk[1 << 16];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fin)) > 0) {
+    contents.insert(contents.end(), chunk, chunk + n);
+  }
+  size_t size = contents.size();
+  contents.resize(size + 2, '\0');
+  buf_begin = cur = contents.data();
+  buf_end = buf_begin + size;
+}
+
+//
+// Keywords
+//
+
+struct Keyword {
+  const char* word;
+  int len;
+  int token;
+};
+
+constexpr int lower(char c) { return c | 0x20; }
+
+constexpr int keyword_hash(const char* s, int len) {
+  return (len * 6 + lower(s[0]) * 4 + lower(s[len - 1]) * 5 + lower(s[1])) & 31;
+}
+
+// Slot i holds the keyword w with keyword_hash(w) == i
+constexpr Keyword keywords[32] = {
+    {nullptr, 0, 0}, {"inherits", 8, INHERITS}, {"new", 3, NEW},
+    {"pool", 4, POOL}, {"in", 2, IN}, {nullptr, 0, 0}, {nullptr, 0, 0},
+    {"loop", 4, LOOP}, {nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+    {"let", 3, LET}, {"of", 2, OF}, {nullptr, 0, 0}, {"esac", 4, ESAC},
+    {"isvoid", 6, ISVOID}, {"false", 5, BOOL_CONST}, {"else", 4, ELSE},
+    {nullptr, 0, 0}, {"true", 4, BOOL_CONST}, {"if", 2, IF},
+    {"class", 5, CLASS}, {"then", 4, THEN}, {nullptr, 0, 0},
+    {nullptr, 0, 0}, {nullptr, 0, 0}, {"fi", 2, FI}, {"while", 5, WHILE},
+    {nullptr, 0, 0}, {"not", 3, NOT}, {"case", 4, CASE}, {nullptr, 0, 0}};
+
+constexpr bool keyword_slots_ok(int i) {
+  return i == 32 ||
+         ((!keywords[i].word ||
+           keyword_hash(keywords[i].word, keywords[i].len) == i) &&
+          keyword_slots_ok(i + 1));
+}
+
+static_assert(keyword_slots_ok(0), "keyword in the wrong slot");
+
+// Returns the keyword token for the identifier s, or 0
+int keyword(const char* s, int len) {
+  if (len < 2 || len > 8) { return 0; }
+  auto& k = keywords[keyword_hash(s, len)];
+  if (k.len != len) { return 0; }
+  for (int i = 0; i < len; i++) {
+    if (lower(s[i]) != k.word[i]) { return 0; }
+  }
+  if (k.token == BOOL_CONST) {
+    // true and false must begin with a lower case letter
+    if (s[0] != k.word[0]) { return 0; }
+    cool_yylval.boolean = k.word[0] == 't';
+  }
+  return k.token;
+}
+
+//
+// Character classes
+//
+
+enum : unsigned char { ID_CHAR = 1, DIGIT = 2 };
+
+struct CharTable {
+  unsigned char flags[256];
+
+  CharTable() {
+    memset(flags, 0, sizeof(flags));
+    for (int c = '0'; c <= '9'; c++) { flags[c] = ID_CHAR | DIGIT; }
+    for (int c = 'a'; c <= 'z'; c++) { flags[c] = flags[c - 'a' + 'A'] = ID_CHAR; }
+    flags['_'] = ID_CHAR;
+  }
+};
+
+const CharTable chars;
+
+inline bool is(char c, unsigned char flag) {
+  return chars.flags[(unsigned char) c] & flag;
+}
+
+//
+// String constants
+//
+
+// Scan the string constant after the opening quote at cur, one
+// character at a time, the way cool.flex does.
+int scan_string() {
+  char* out = string_buf;
+  for (;;) {
+    if (cur == buf_end) { RET_ERROR("EOF in string constant") }
+    char c = *cur++;
+    switch (c) {
+      case '"':
+        cool_yylval.symbol = stringtable.add_string(string_buf, out - string_buf);
+        return STR_CONST;
+      case '\n':
+        curr_lineno++;
+        RET_ERROR("Unterminated string constant")
+      case '\0':
+        skip_string = true;
+        RET_ERROR("String contains null character")
+      case '\\':
+        if (cur == buf_end) { break; }  // a lone backslash stands for itself
+        c = *cur++;
+        switch (c) {
+          case '\n': curr_lineno++; break;
+          case '\0':
+            skip_string = true;
+            RET_ERROR("String contains escaped null character")
+          case 'b': c = '\b'; break;
+          case 't': c = '\t'; break;
+          case 'n': c = '\n'; break;
+          case 'f': c = '\f'; break;
+          default: break;
+        }
+        break;
+      default:
+        break;
+    }
+    if (out - string_buf + 1 < MAX_STR_CONST) {
+      *out++ = c;
+    } else {
+      skip_string = true;
+      RET_ERROR("String constant too long")
+    }
+  }
+}
+
+// The string constant after the opening quote at cur: without escapes
+// it is interned right from the buffer.
+int string_constant() {
+  const char* start = cur;
+  const char* p = start;
+  while (*p != '"' && *p != '\\' && *p != '\n' && *p != '\0') { p++; }
+  if (*p != '"') { return scan_string(); }
+  cur = p + 1;
+  if (p - start >= MAX_STR_CONST) { RET_ERROR("String constant too long") }
+  cool_yylval.symbol = stringtable.add_string(start, p - start);
+  return STR_CONST;
+}
+
+// Skip to the end of a string constant with an error
+void skip_rest_of_string() {
+  skip_string = false;
+  while (cur != buf_end) {
+    char c = *cur++;
+    if (c == '\n') {
+      curr_lineno++;
+      return;
+    }
+    if (c == '"') { return; }
+  }
+}
+
+// Skip a (nested) comment after the opening "(*"
+bool skip_comment() {
+  int depth = 1;
+  while (cur != buf_end) {
+    char c = *cur++;
+    if (c == '\n') {
+      curr_lineno++;
+    } else if (c == '(' && *cur == '*' && cur != buf_end) {
+      cur++;
+      depth++;
+    } else if (c == '*' && *cur == ')' && cur != buf_end) {
+      cur++;
+      if (--depth == 0) { return true; }
+    }
+  }
+  return false;
+}
+
+}
+
+//
+// Scan the whole source in place.  base holds size bytes followed by
+// two null bytes.
+//
+void cool_yy_scan_source(char* base, size_t size) {
+  buf_begin = cur = base;
+  buf_end = base + size;
+  skip_string = false;
+}
+
+int cool_yylex() {
+  if (!buf_begin) { read_fin(); }
+  if (skip_string) { skip_rest_of_string(); }
+  for (;;) {
+    const char* start = cur;
+    char c = *cur++;
+    switch (c) {
+      case '\0':
+        if (start == buf_end) {
+          cur = start;
+          return 0;
+        }
+        error_char[0] = '\0';
+        RET_ERROR(error_char)
+      case '\n':
+        curr_lineno++;
+        continue;
+      case ' ': case '\t': case '\f': case '\r': case '\v':
+        continue;
+      case '-':
+        if (*cur == '-') {
+          while (*cur != '\n' && *cur != '\0') { cur++; }
+          continue;
+        }
+        return c;
+      case '(':
+        if (*cur == '*') {
+          cur++;
+          if (!skip_comment()) { RET_ERROR("EOF in comment") }
+          continue;
+        }
+        return c;
+      case '*':
+        if (*cur == ')') {
+          cur++;
+          RET_ERROR("Unmatched *)")
+        }
+        return c;
+      case '"':
+        return string_constant();
+      case '<':
+        if (*cur == '-') { cur++; return ASSIGN; }
+        if (*cur == '=') { cur++; return LE; }
+        return c;
+      case '=':
+        if (*cur == '>') { cur++; return DARROW; }
+        return c;
+      case '+': case '/': case '.': case '~': case ',': case ';': case ':':
+      case ')': case '@': case '{': case '}':
+        return c;
+      default:
+        break;
+    }
+    if (is(c, DIGIT)) {
+      while (is(*cur, DIGIT)) { cur++; }
+      cool_yylval.symbol = inttable.add_string(start, cur - start);
+      return INT_CONST;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      while (is(*cur, ID_CHAR)) { cur++; }
+      int len = cur - start;
+      if (int token = keyword(start, len)) { return token; }
+      cool_yylval.symbol = idtable.add_string(start, len);
+      return (c >= 'A' && c <= 'Z') ? TYPEID : OBJECTID;
+    }
+    error_char[0] = c;
+    RET_ERROR(error_char)
+  }
+}
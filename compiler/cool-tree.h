@@ -148,6 +148,7 @@ class program_class : public Program_class {
   Classes classes;
  public:
   program_class(Classes a1) {
+    kind = program_kind;
     classes = a1;
   }
 
@@ -175,6 +176,7 @@ class class__class : public Class__class {
   Symbol filename;
  public:
   class__class(Symbol a1, Symbol a2, Features a3, Symbol a4) {
+    kind = class__kind;
     name = a1;
     parent = a2;
     features = a3;
@@ -205,6 +207,7 @@ class method_class : public Feature_class {
   Expression expr;
  public:
   method_class(Symbol a1, Formals a2, Symbol a3, Expression a4) {
+    kind = method_kind;
     name = a1;
     formals = a2;
     return_type = a3;
@@ -234,6 +237,7 @@ class attr_class : public Feature_class {
   Expression init;
  public:
   attr_class(Symbol a1, Symbol a2, Expression a3) {
+    kind = attr_kind;
     name = a1;
     type_decl = a2;
     init = a3;
@@ -261,6 +265,7 @@ class formal_class : public Formal_class {
   Symbol type_decl;
  public:
   formal_class(Symbol a1, Symbol a2) {
+    kind = formal_kind;
     name = a1;
     type_decl = a2;
   }
@@ -288,6 +293,7 @@ class branch_class : public Case_class {
   Expression expr;
  public:
   branch_class(Symbol a1, Symbol a2, Expression a3) {
+    kind = branch_kind;
     name = a1;
     type_decl = a2;
     expr = a3;
@@ -315,6 +321,7 @@ class assign_class : public Expression_class {
   Expression expr;
  public:
   assign_class(Symbol a1, Expression a2) {
+    kind = assign_kind;
     name = a1;
     expr = a2;
   }
@@ -343,6 +350,7 @@ class static_dispatch_class : public Expression_class {
   Expressions actual;
  public:
   static_dispatch_class(Expression a1, Symbol a2, Symbol a3, Expressions a4) {
+    kind = static_dispatch_kind;
     expr = a1;
     type_name = a2;
     name = a3;
@@ -372,6 +380,7 @@ class dispatch_class : public Expression_class {
   Expressions actual;
  public:
   dispatch_class(Expression a1, Symbol a2, Expressions a3) {
+    kind = dispatch_kind;
     expr = a1;
     name = a2;
     actual = a3;
@@ -400,6 +409,7 @@ class cond_class : public Expression_class {
   Expression else_exp;
  public:
   cond_class(Expression a1, Expression a2, Expression a3) {
+    kind = cond_kind;
     pred = a1;
     then_exp = a2;
     else_exp = a3;
@@ -427,6 +437,7 @@ class loop_class : public Expression_class {
   Expression body;
  public:
   loop_class(Expression a1, Expression a2) {
+    kind = loop_kind;
     pred = a1;
     body = a2;
   }
@@ -453,6 +464,7 @@ class typcase_class : public Expression_class {
   Cases cases;
  public:
   typcase_class(Expression a1, Cases a2) {
+    kind = typcase_kind;
     expr = a1;
     cases = a2;
   }
@@ -478,6 +490,7 @@ class block_class : public Expression_class {
   Expressions body;
  public:
   block_class(Expressions a1) {
+    kind = block_kind;
     body = a1;
   }
 
@@ -505,6 +518,7 @@ class let_class : public Expression_class {
   Expression body;
  public:
   let_class(Symbol a1, Symbol a2, Expression a3, Expression a4) {
+    kind = let_kind;
     identifier = a1;
     type_decl = a2;
     init = a3;
@@ -533,6 +547,7 @@ class plus_class : public Expression_class {
   Expression e2;
  public:
   plus_class(Expression a1, Expression a2) {
+    kind = plus_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -559,6 +574,7 @@ class sub_class : public Expression_class {
   Expression e2;
  public:
   sub_class(Expression a1, Expression a2) {
+    kind = sub_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -585,6 +601,7 @@ class mul_class : public Expression_class {
   Expression e2;
  public:
   mul_class(Expression a1, Expression a2) {
+    kind = mul_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -611,6 +628,7 @@ class divide_class : public Expression_class {
   Expression e2;
  public:
   divide_class(Expression a1, Expression a2) {
+    kind = divide_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -636,6 +654,7 @@ class neg_class : public Expression_class {
   Expression e1;
  public:
   neg_class(Expression a1) {
+    kind = neg_kind;
     e1 = a1;
   }
 
@@ -661,6 +680,7 @@ class lt_class : public Expression_class {
   Expression e2;
  public:
   lt_class(Expression a1, Expression a2) {
+    kind = lt_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -687,6 +707,7 @@ class eq_class : public Expression_class {
   Expression e2;
  public:
   eq_class(Expression a1, Expression a2) {
+    kind = eq_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -713,6 +734,7 @@ class leq_class : public Expression_class {
   Expression e2;
  public:
   leq_class(Expression a1, Expression a2) {
+    kind = leq_kind;
     e1 = a1;
     e2 = a2;
   }
@@ -738,6 +760,7 @@ class comp_class : public Expression_class {
   Expression e1;
  public:
   comp_class(Expression a1) {
+    kind = comp_kind;
     e1 = a1;
   }
 
@@ -762,6 +785,7 @@ class int_const_class : public Expression_class {
   Symbol token;
  public:
   int_const_class(Symbol a1) {
+    kind = int_const_kind;
     token = a1;
   }
 
@@ -786,6 +810,7 @@ class bool_const_class : public Expression_class {
   Boolean val;
  public:
   bool_const_class(Boolean a1) {
+    kind = bool_const_kind;
     val = a1;
   }
 
@@ -810,6 +835,7 @@ class string_const_class : public Expression_class {
   Symbol token;
  public:
   string_const_class(Symbol a1) {
+    kind = string_const_kind;
     token = a1;
   }
 
@@ -834,6 +860,7 @@ class new__class : public Expression_class {
   Symbol type_name;
  public:
   new__class(Symbol a1) {
+    kind = new__kind;
     type_name = a1;
   }
 
@@ -858,6 +885,7 @@ class isvoid_class : public Expression_class {
   Expression e1;
  public:
   isvoid_class(Expression a1) {
+    kind = isvoid_kind;
     e1 = a1;
   }
 
@@ -881,6 +909,7 @@ class no_expr_class : public Expression_class {
  public:
  public:
   no_expr_class() {
+    kind = no_expr_kind;
   }
 
   Expression copy_Expression();
@@ -904,6 +933,7 @@ class object_class : public Expression_class {
   Symbol name;
  public:
   object_class(Symbol a1) {
+    kind = object_kind;
     name = a1;
   }
 
@@ -922,6 +952,23 @@ class object_class : public Expression_class {
 };
 
 
+// Call v with node cast to the class of its constructor, for example
+// v(static_cast<method_class*>(node)) for a method; lists are passed as
+// tree_node*.  The overloads of v's operator() pick the nodes a pass
+// handles, with one for a base class (or tree_node*) taking the rest.
+template<class Visitor>
+auto visit(tree_node* node, Visitor& v) -> decltype(v(node)) {
+  switch (node->get_kind()) {
+#define VISIT_KIND(name) \
+    case name##_kind: return v(static_cast<name##_class*>(node));
+    COOL_NODE_KINDS(VISIT_KIND)
+#undef VISIT_KIND
+    default:
+      return v(node);
+  }
+}
+
+
 // define the prototypes of the interface
 Classes nil_Classes();
 
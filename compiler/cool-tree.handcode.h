@@ -5,6 +5,7 @@
 #define COOL_TREE_HANDCODE_H
 
 #include <iostream>
+#include <map>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
@@ -20,7 +21,7 @@ using tac::CodeSection;
 
 #define yylineno curr_lineno;
 
-extern int yylineno;
+extern thread_local int yylineno;
 
 inline Boolean copy_Boolean(Boolean b) { return b; }
 
@@ -71,15 +72,21 @@ typedef Expressions_class* Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class* Cases;
 
+// With -u the code of the classes of each input file goes to a unit of
+// its own, keyed by file name
+typedef std::map<Symbol, ostream*> CodeUnits;
+
 #define Program_EXTRAS                          \
 virtual void semant() = 0;                      \
-virtual void cgen(ostream&) = 0;                \
+virtual void install_classes() = 0;             \
+virtual void cgen(ostream&, const CodeUnits& units = CodeUnits()) = 0; \
 virtual void dump_with_types(ostream&, int) = 0;
 
 
 #define program_EXTRAS                          \
 void semant();                                  \
-void cgen(ostream&);                            \
+void install_classes();                         \
+void cgen(ostream&, const CodeUnits& units = CodeUnits()); \
 void dump_with_types(ostream&, int);
 
 #define Class__EXTRAS                           \
@@ -1,23 +1,36 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "astfile.h"
 #include "cool-io.h"
 #include "cool-tree.h"
+#include "parallel.h"
+#include "server.h"
+#include "timereport.h"
 #include "utilities.h"
 
 FILE* fin;   // This is the file pointer from which the compiler reads its input.
 
 extern int optind;            // for option processing
-extern char* filename;    // output name without suffix
-extern Program ast_root;             // root of the abstract syntax tree
+extern char* filename;    // output name, from -o
+extern int emit_units;    // -u: an assembly unit for each input file
+extern char* ast_filename;  // -A: save the AST to this file
+extern int serve_requests;  // -i: compile the requests read from stdin
+extern thread_local Program ast_root;             // root of the abstract syntax tree
 
 extern int cool_yylex();
+extern void cool_yy_scan_source(char* base, size_t size);
 
-extern YYSTYPE cool_yylval;           // Not compiled with parser, so must define this.
 extern int cool_yydebug;     // not used, but needed to link with handle_flags
-extern int curr_lineno;
-char* curr_filename;
-extern int omerrs;             // a count of lex and parse errors
+extern thread_local int curr_lineno;
+thread_local char* curr_filename;
+extern thread_local int omerrs;             // a count of lex and parse errors
+extern thread_local std::ostringstream* parse_errors;
 extern int cool_yyparse();
 
 void handle_flags(int argc, char* argv[]);
@@ -42,84 +55,253 @@ void dump_semant() {
   ast_root->dump_with_types(cout, 0);
 }
 
-int main(int argc, char* argv[]) {
-  //
-  // Init global variables
-  //
+// An input file, lexed and parsed on a thread of its own
+struct SourceFile {
+  char* name;
+  char* text;
+  size_t size;
+  std::ostringstream errors;  // its lex and parse errors
+  int nerrs;
+  Program program;            // NULL if nothing could be parsed
+  bool checked;               // an AST file saved after type checking
+  std::set<Symbol> filenames; // those of its classes: its unit with -u
+};
+
+// Parse file, the one at position in the input, on this thread.  The
+// strings it adds are numbered after position (see string_use).
+void parse_file(SourceFile& file, int position) {
+  curr_filename = file.name;
   curr_lineno = 1;
-  //
-  // Handle flags
-  //
-  handle_flags(argc, argv);
+  omerrs = 0;
+  parse_errors = &file.errors;
+  string_use = (long long) position << 40;
+  file.checked = false;
+  if (is_ast_file(file.text, file.size)) {
+    // Saved by coolc -A, so there is nothing to lex or parse
+    AstStage stage;
+    std::string error;
+    file.program = read_ast(file.text, file.size, &stage, error);
+    if (file.program) {
+      file.checked = stage == AST_CHECKED;
+    } else {
+      file.errors << "\"" << file.name << "\": " << error << endl;
+      omerrs++;
+    }
+  } else {
+    cool_yy_scan_source(file.text, file.size);
+    ast_root = NULL;
+    cool_yyparse();
+    file.program = ast_root;
+  }
+  if (file.program && omerrs == 0) {
+    // An AST file keeps the names of the files its classes were parsed from
+    Classes classes = static_cast<program_class*>(file.program)->classes;
+    for (int i = classes->first(); classes->more(i); i = classes->next(i)) {
+      file.filenames.insert(classes->nth(i)->get_filename());
+    }
+  }
+  file.nerrs = omerrs;
+  string_use = -1;
+  parse_errors = NULL;
+}
 
-  //
-  // Process files and names
-  //
-  curr_filename = strdup(argv[optind]);
-  fin = fopen(curr_filename, "r");
+// Save the AST to the file named with -A
+void save_ast(AstStage stage) {
+  PhaseTimer timer("save AST");
+  if (!write_ast(ast_filename, ast_root, stage)) {
+    cerr << "Could not write AST file " << ast_filename << endl;
+    exit(1);
+  }
+}
+
+// The name of the assembly file for source name: the name without its
+// extension, followed by suffix
+std::string output_name(const char* name, const char* suffix) {
+  std::string out = name;
+  auto dot = out.rfind('.');
+  if (dot != std::string::npos && out.find('/', dot) == std::string::npos) {
+    out.erase(dot);
+  }
+  return out + suffix;
+}
 
-  if (fin == NULL) {
-    cerr << "Could not open input file " << curr_filename << endl;
+// Compile the input files of a command line whose flags handle_flags
+// has read.  Returns the exit status.
+int compile_files(int argc, char* argv[]) {
+  if (optind == argc) {
+    cerr << "coolc: no input files" << endl;
     exit(1);
   }
 
+  //
+  // Output names.  With -u, the file named with -o only holds what the
+  // units share: the tables, constants and the basic classes.
+  //
   std::string out_filename;
-  if (!filename && optind < argc) {   // no -o option
-    char* dot = strrchr(argv[optind], '.');
-    if (dot) { *dot = '\0'; } // strip off file extension
-    filename = new char[strlen(argv[optind]) + 8];
-    strcpy(filename, argv[optind]);
-    out_filename = std::string(filename) + ".s";
-  } else {
+  if (filename) {
     out_filename = filename;
+  } else {
+    out_filename = output_name(argv[optind], emit_units ? ".link.s" : ".s");
+  }
+  if (emit_units) {
+    for (int i = optind; i < argc; i++) {
+      if (output_name(argv[i], ".s") == out_filename) {
+        cerr << "coolc: the -o file " << out_filename
+             << " is also the unit of " << argv[i] << endl;
+        exit(1);
+      }
+    }
   }
 
   //
-  // Lexer
+  // Read every input file
+  //
+  PhaseTimer read_timer("read");
+  std::vector<SourceFile> files(argc - optind);
+  for (size_t i = 0; i < files.size(); i++) {
+    auto& file = files[i];
+    file.name = strdup(argv[optind + i]);
+    fin = fopen(file.name, "r");
+    if (fin == NULL) {
+      cerr << "Could not open input file " << file.name << endl;
+      exit(1);
+    }
+    file.text = read_source(fin, &file.size);
+    fclose(fin);
+    if (!file.text) {
+      cerr << "Could not read input file " << file.name << endl;
+      exit(1);
+    }
+  }
+  read_timer.stop();
+
   //
+  // Lex and parse them, on a pool of threads, into one program.  Their
+  // errors come out in the order of the files.
+  //
+  program_class* first = NULL;
+  bool checked = false;  // a type checked AST file, compiled alone
+  PhaseTimer parse_timer(do_lexer ? "lexer" : "parse");
   if (do_lexer) {
-    dump_lexer();
-    goto finish;
+    for (auto& file: files) {
+      curr_filename = file.name;
+      curr_lineno = 1;
+      cool_yy_scan_source(file.text, file.size);
+      dump_lexer();
+    }
+  } else {
+    auto phase = PhaseTimer::current();
+    parallel_for(files.size(), [&](int i) {
+      PhaseWorker worker(phase);
+      PhaseTimer timer("file");
+      parse_file(files[i], i);
+    });
+    idtable.sort_by_first_use();
+    inttable.sort_by_first_use();
+    stringtable.sort_by_first_use();
+    omerrs = 0;
+    for (auto& file: files) {
+      cerr << file.errors.str();
+      omerrs += file.nerrs;
+      if (file.nerrs > MAX_PARSE_ERRORS) {
+        cout << "More than " << MAX_PARSE_ERRORS << " errors" << endl;
+        exit(1);
+      }
+      if (!file.program) { continue; }
+      auto root = static_cast<program_class*>(file.program);
+      if (first) {
+        first->classes = append_Classes(first->classes, root->classes);
+      } else {
+        first = root;
+      }
+    }
+    curr_filename = files.back().name;
+    checked = files.size() == 1 && files[0].checked;
   }
+  parse_timer.stop();
+
+  //
+  // Lexer
+  //
+  if (do_lexer) { goto finish; }
 
   //
   // Parser
   //
-  cool_yyparse();
   if (omerrs != 0) {
     cerr << "Compilation halted due to lex and parse errors\n";
     exit(1);
   }
+  ast_root = first;
 
   if (do_parser) {
-    dump_parser();
+    if (ast_filename) {
+      save_ast(AST_PARSED);
+    } else {
+      dump_parser();
+    }
     goto finish;
   }
 
   //
-  // Semant
+  // Semant, unless the program was type checked before it was saved
   //
-  ast_root->semant();
+  {
+    PhaseTimer timer("semant");
+    if (checked) {
+      ast_root->install_classes();
+    } else {
+      ast_root->semant();
+    }
+  }
+
+  if (ast_filename) { save_ast(AST_CHECKED); }
 
   if (do_semant) {
-    dump_semant();
+    if (!ast_filename) { dump_semant(); }
     goto finish;
   }
 
   //
   // Code Generation
   //
-  if (filename) {
+  {
+    PhaseTimer timer("cgen");
     ofstream s(out_filename);
-    ast_root->cgen(s);
-  } else {
-    ast_root->cgen(cout);
+    std::vector<std::unique_ptr<ofstream>> unit_files;
+    CodeUnits units;
+    if (emit_units) {
+      for (auto& file: files) {
+        unit_files.emplace_back(new ofstream(output_name(file.name, ".s")));
+        for (Symbol name: file.filenames) {
+          units[name] = unit_files.back().get();
+        }
+      }
+    }
+    ast_root->cgen(s, units);
   }
 
   //
   // Program finish
   //
   finish:
-  fclose(fin);
+  free_tree_nodes();
   return 0;
 }
+
+// Compile, and report the time of each phase with -ftime-report
+int compile(int argc, char* argv[]) {
+  if (time_report) { write_time_report_at_exit(); }
+  PhaseTimer timer("coolc");
+  return compile_files(argc, argv);
+}
+
+int main(int argc, char* argv[]) {
+  //
+  // Handle flags
+  //
+  handle_flags(argc, argv);
+
+  if (serve_requests) { return serve(compile); }
+  return compile(argc, argv);
+}
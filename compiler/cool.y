@@ -11,12 +11,15 @@
   #include "stringtab.h"
   #include "utilities.h"
   
-  extern char *curr_filename;
+  #include <sstream>
+  
+  extern thread_local char *curr_filename;
 
-  #define cool_yylloc curr_lineno  /* use the curr_lineno from the lexer
-  for the location of tokens */
+  /* The parser is pure and the lexer keeps its state per thread, so that
+  several files can be parsed at once, one per thread.  The location of
+  a token is the curr_lineno of the lexer, see yylex below. */
     
-    extern int node_lineno;          /* set before constructing a tree node
+    extern thread_local int node_lineno;  /* set before constructing a tree node
     to whatever you want the line number
     for the tree node to be */
       
@@ -73,17 +76,21 @@
     
     
     
-    void yyerror(char *s);        /*  defined below; called for each parse error */
+    void yyerror(YYLTYPE *loc, const char *s);  /*  defined below; called for each parse error */
     extern int yylex();           /*  the entry point to the lexer  */
     
     /************************************************************************/
     /*                DONT CHANGE ANYTHING IN THIS SECTION                  */
     
-    Program ast_root;	      /* the result of the parse  */
-    Classes parse_results;        /* for use in semantic analysis */
-    int omerrs = 0;               /* number of errors in lexing and parsing */
+    thread_local Program ast_root;	      /* the result of the parse  */
+    thread_local Classes parse_results;        /* for use in semantic analysis */
+    thread_local int omerrs = 0;               /* number of errors in lexing and parsing */
+    thread_local int curr_lineno = 1;          /* the line the lexer is on */
+    thread_local std::ostringstream *parse_errors = NULL;  /* where errors go, or cerr */
     %}
     
+    %define api.pure full
+    
     /* A union of all the types that can be the result of parsing actions. */
     %union {
       Boolean boolean;
@@ -102,6 +109,11 @@
       char *error_msg;
     }
     
+    %code {
+      thread_local YYSTYPE cool_yylval;  /* the value of the last token */
+      static int yylex(YYSTYPE *lval, YYLTYPE *lloc);
+    }
+    
     /* 
     Declare the terminals; a few have types for associated lexemes.
     The token ERROR is never used in the parser; thus, it is a parse
@@ -365,18 +377,32 @@
     /* end of grammar */
     %%
     
+    /* The last token from the lexer, the lookahead on an error */
+    static thread_local int last_token;
+    
+    /* The pure parser's view of the lexer */
+    static int yylex(YYSTYPE *lval, YYLTYPE *lloc)
+    {
+      /* Past MAX_PARSE_ERRORS the rest of the file is skipped: the parser,
+         recovering from the last error, stops at the end of the input */
+      if (omerrs > MAX_PARSE_ERRORS) {
+        return last_token = 0;
+      }
+      last_token = yylex();
+      *lval = cool_yylval;
+      *lloc = curr_lineno;
+      return last_token;
+    }
+    
     /* This function is called automatically when Bison detects a parse error. */
-    void yyerror(char *s)
+    void yyerror(YYLTYPE *loc, const char *s)
     {
-      extern int curr_lineno;
-      
-      cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": " \
+      ostream &err = parse_errors ? *parse_errors : cerr;
+      err << "\"" << curr_filename << "\", line " << *loc << ": " \
       << s << " at or near ";
-      print_cool_token(yychar);
-      cerr << endl;
+      print_cool_token(err, last_token);
+      err << endl;
       omerrs++;
-      
-      if(omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
     }
     
     
\ No newline at end of file
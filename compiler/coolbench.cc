@@ -0,0 +1,253 @@
+//
+// Front end benchmark.  Generates a synthetic Cool program of a given
+// size and times the lexer, the parser and semant on it, each in a
+// child process of its own.  The phases before the one timed run in the
+// same child, so its peak RSS is that of all of them; the growth of the
+// peak while the phase runs is reported as well.
+//
+// usage: coolbench [-c classes] [-m methods] [-s string-length]
+//                  [-d comment-depth] [-r runs] [-o file]
+//
+// -o writes the generated program to file as well.  Each phase is run
+// the given number of times and the fastest run is reported.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include "cool-io.h"
+#include "cool-tree.h"
+#include "utilities.h"
+
+using std::string;
+using std::vector;
+using std::ostringstream;
+
+FILE* fin;   // not read: the source is scanned from memory
+thread_local char* curr_filename = (char*) "<synthetic>";
+
+extern thread_local Program ast_root;
+extern thread_local int omerrs;
+extern thread_local int curr_lineno;
+extern int cool_yylex();
+extern int cool_yyparse();
+extern void cool_yy_scan_source(char* base, size_t size);
+
+namespace {
+
+struct Options {
+  int classes = 1000;
+  int methods = 8;
+  int string_length = 200;
+  int comment_depth = 16;
+  int runs = 3;
+  const char* output = nullptr;
+};
+
+// Every class opens with a comment nested depth levels deep and holds
+// methods with lets, loops, conditionals, cases, dispatch and long
+// string constants.  Every eighth class starts a new inheritance chain
+// off IO; the others override the methods of their parent.
+string generate(const Options& opt) {
+  ostringstream s;
+  string text;
+  for (int i = 0; i < opt.string_length; i++) {
+    text += (i % 32 == 31) ? ' ' : (char) ('a' + i % 26);
+  }
+  for (int c = 0; c < opt.classes; c++) {
+    for (int d = 0; d < opt.comment_depth; d++) {
+      s << string(d, ' ') << "(* level " << d << " of class C" << c << "\n";
+    }
+    for (int d = opt.comment_depth - 1; d >= 0; d--) {
+      s << string(d, ' ') << "*)\n";
+    }
+    s << "class C" << c << " inherits ";
+    if (c % 8 == 0) {
+      s << "IO";
+    } else {
+      s << "C" << c - 1;
+    }
+    s << " {\n"
+      << "  a" << c << " : Int <- " << c << ";\n"
+      << "  s" << c << " : String <- \"" << text << "\";\n";
+    for (int m = 0; m < opt.methods; m++) {
+      s << "  -- method " << m << " of class C" << c << "\n"
+        << "  m" << m << "(x : Int, y : String) : Int {\n"
+        << "    let i : Int <- x + a" << c << ", t : String <- y.concat(\""
+        << text << "\\n\") in {\n"
+        << "      while i < " << 10 + m << " loop i <- i + 1 pool;\n"
+        << "      if t.length() = 0 then out_string(t) else out_int(i * 2) fi;\n"
+        << "      s" << c << " <- s" << c << ".substr(0, " << m << ");\n"
+        << "      case self of o : Object => i; d : C" << c
+        << " => d.m0(i - 1, t); esac;\n"
+        << "    }\n"
+        << "  };\n";
+    }
+    s << "};\n\n";
+  }
+  s << "class Main {\n"
+    << "  main() : Object { (new C" << opt.classes - 1 << ").m0(1, \"a\") };\n"
+    << "};\n";
+  return s.str();
+}
+
+enum Phase { LEXER, PARSER, SEMANT };
+
+struct Result {
+  long tokens;
+  double seconds;
+  long max_rss;  // in kilobytes, of the child
+  long rss_growth;  // of max_rss while the phase ran
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The peak RSS of this process so far, in kilobytes
+long max_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Run phase (and the phases before it, untimed) on source
+Result run_phase(Phase phase, const string& source) {
+  vector<char> buf(source.begin(), source.end());
+  buf.resize(source.size() + 2, '\0');
+  cool_yy_scan_source(buf.data(), source.size());
+  curr_lineno = 1;
+
+  Result r = {0, 0, 0, 0};
+  long rss_before = max_rss();
+  auto start = std::chrono::steady_clock::now();
+  if (phase == LEXER) {
+    while (cool_yylex() != 0) { r.tokens++; }
+    r.seconds = seconds_since(start);
+  } else {
+    cool_yyparse();
+    r.seconds = seconds_since(start);
+    if (omerrs != 0) {
+      cerr << "coolbench: lex and parse errors in the generated program\n";
+      exit(1);
+    }
+    if (phase == SEMANT) {
+      rss_before = max_rss();
+      start = std::chrono::steady_clock::now();
+      ast_root->semant();
+      r.seconds = seconds_since(start);
+    }
+  }
+  r.max_rss = max_rss();
+  r.rss_growth = r.max_rss - rss_before;
+  return r;
+}
+
+// Run phase in a child process and collect its result through a pipe
+Result fork_phase(Phase phase, const string& source) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("coolbench: pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("coolbench: fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    Result r = run_phase(phase, source);
+    if (write(fds[1], &r, sizeof(r)) != sizeof(r)) { _exit(1); }
+    _exit(0);
+  }
+  close(fds[1]);
+  Result r;
+  ssize_t n = read(fds[0], &r, sizeof(r));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (n != sizeof(r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    cerr << "coolbench: phase " << phase << " failed\n";
+    exit(1);
+  }
+  return r;
+}
+
+void usage(const char* name) {
+  cerr << "usage: " << name
+       << " [-c classes] [-m methods] [-s string-length]"
+          " [-d comment-depth] [-r runs] [-o file]\n";
+  exit(1);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options opt;
+  int c;
+  while ((c = getopt(argc, argv, "c:m:s:d:r:o:")) != -1) {
+    switch (c) {
+      case 'c': opt.classes = atoi(optarg); break;
+      case 'm': opt.methods = atoi(optarg); break;
+      case 's': opt.string_length = atoi(optarg); break;
+      case 'd': opt.comment_depth = atoi(optarg); break;
+      case 'r': opt.runs = atoi(optarg); break;
+      case 'o': opt.output = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || opt.classes < 1 || opt.methods < 1 ||
+      opt.string_length < 0 || opt.string_length > 1000 ||
+      opt.comment_depth < 0 || opt.runs < 1) {
+    usage(argv[0]);
+  }
+
+  string source = generate(opt);
+  if (opt.output) {
+    ofstream out(opt.output);
+    out << source;
+    if (!out) {
+      cerr << "coolbench: could not write " << opt.output << endl;
+      exit(1);
+    }
+  }
+
+  static const char* names[] = {"lexer", "parser", "semant"};
+  Result best[3];
+  for (int p = LEXER; p <= SEMANT; p++) {
+    best[p] = fork_phase((Phase) p, source);
+    for (int i = 1; i < opt.runs; i++) {
+      Result r = fork_phase((Phase) p, source);
+      if (r.seconds < best[p].seconds) { best[p].seconds = r.seconds; }
+      if (r.max_rss > best[p].max_rss) { best[p].max_rss = r.max_rss; }
+      if (r.rss_growth > best[p].rss_growth) { best[p].rss_growth = r.rss_growth; }
+    }
+  }
+  long tokens = best[LEXER].tokens;
+
+  cout << opt.classes << " classes, " << source.size() << " bytes, "
+       << tokens << " tokens\n"
+       << "(parser includes the lexer; semant is timed alone, and its peak\n"
+       << " RSS includes the parse)\n\n"
+       << std::left << std::setw(8) << "phase" << std::right
+       << std::setw(10) << "seconds" << std::setw(14) << "tokens/s"
+       << std::setw(10) << "MB/s" << std::setw(16) << "peak RSS (KB)"
+       << std::setw(14) << "growth (KB)" << "\n";
+  for (int p = LEXER; p <= SEMANT; p++) {
+    double secs = best[p].seconds > 0 ? best[p].seconds : 1e-9;
+    cout << std::left << std::setw(8) << names[p] << std::right
+         << std::fixed << std::setprecision(4) << std::setw(10) << best[p].seconds
+         << std::setprecision(0) << std::setw(14) << tokens / secs
+         << std::setprecision(1) << std::setw(10) << source.size() / secs / 1e6
+         << std::setw(16) << best[p].max_rss
+         << std::setw(14) << best[p].rss_growth << "\n";
+  }
+  return 0;
+}
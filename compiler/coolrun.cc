@@ -0,0 +1,1137 @@
+//
+// coolrun: a small MIPS simulator for the output of coolc.
+//
+// Only the part of the spim assembler and instruction set used by coolc
+// and runtime/mips.handler is supported.  The command line mirrors spim,
+// so the test scripts can run either one:
+//
+//   coolrun [-trap_file <handler>] [-file] <program.s>
+//
+// Both files are assembled once into a flat array of pre-decoded
+// instructions.  As in spim, a label is local to its file unless the
+// file declares it .globl, so programs split over several files (coolc
+// -u) need their shared labels declared global to run.  Every source
+// instruction (including pseudo instructions) takes exactly one slot,
+// branch and jump targets are resolved to slot indices, and the
+// interpreter loop dispatches through a table of label addresses (direct
+// threading).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <iostream>
+
+using std::string;
+using std::vector;
+using std::map;
+using std::set;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+const uint32_t TEXT_BASE = 0x00400000;
+const uint32_t DATA_BASE = 0x10000000;
+const uint32_t KTEXT_BASE = 0x80000080;
+const uint32_t KDATA_BASE = 0x90000000;
+const uint32_t STACK_TOP = 0x80000000;
+const uint32_t STACK_SIZE = 64 << 20;
+const uint32_t STACK_BASE = STACK_TOP - STACK_SIZE;
+const uint32_t INITIAL_SP = 0x7fffeffc;
+// Room between the static data and the first sbrk, like spim's
+// initial data segment.
+const uint32_t INITIAL_HEAP = 1 << 20;
+const uint32_t MAX_DATA = 1u << 30;
+
+const char* TRAP_FILE = "../../runtime/mips.handler";
+
+// Exception codes, as found in the Cause register
+enum {
+  EXC_ADDRL = 4, EXC_ADDRS = 5, EXC_IBUS = 6, EXC_DBUS = 7,
+  EXC_SYSCALL = 8, EXC_BKPT = 9, EXC_RI = 10, EXC_OVF = 12
+};
+
+//
+// Operations of the pre-decoded instructions.  Binary ALU operations and
+// conditional branches come in two flavours: the second operand is
+// either the register rt or the immediate imm.
+//
+#define COOLRUN_ALU_OPS(X) \
+  X(ADD) X(ADDU) X(SUB) X(SUBU) X(AND) X(OR) X(XOR) X(NOR) \
+  X(SLT) X(SLTU) X(SGT) X(SGTU) X(SGE) X(SGEU) X(SLE) X(SLEU) X(SEQ) X(SNE) \
+  X(SLL) X(SRL) X(SRA) X(MUL) X(DIV) X(DIVU) X(REM) X(REMU)
+
+#define COOLRUN_BRANCH_OPS(X) \
+  X(BEQ) X(BNE) X(BLT) X(BLE) X(BGT) X(BGE) X(BLTU) X(BLEU) X(BGTU) X(BGEU)
+
+#define COOLRUN_OTHER_OPS(X) \
+  X(MOVE) X(NEG) X(NEGU) X(NOT) X(ABS) X(LI) X(LUI) \
+  X(MULT) X(MULTU) X(DIVHL) X(DIVUHL) X(MFHI) X(MFLO) X(MTHI) X(MTLO) \
+  X(LW) X(LH) X(LHU) X(LB) X(LBU) X(SW) X(SH) X(SB) \
+  X(B) X(JAL) X(JR) X(JALR) \
+  X(SYSCALL) X(BREAK) X(MFC0) X(MTC0) X(RFE) X(NOP) X(FALLOFF)
+
+enum Opcode {
+#define X(n) OP_##n, OP_##n##_I,
+  COOLRUN_ALU_OPS(X)
+  COOLRUN_BRANCH_OPS(X)
+#undef X
+#define X(n) OP_##n,
+  COOLRUN_OTHER_OPS(X)
+#undef X
+  NUM_OPS
+};
+
+struct Insn {
+  const void* handler;
+  int32_t imm;        // immediate operand or memory offset
+  uint32_t target;    // branch target (index into the code array)
+  uint8_t op;
+  uint8_t rd, rs, rt;
+};
+
+// Where a source line came from, for diagnostics
+struct SourcePos {
+  const string* file;
+  int line;
+};
+
+// A symbol is either an address in one of the segments or a constant
+enum SymKind { SYM_TEXT, SYM_KTEXT, SYM_DATA, SYM_KDATA, SYM_CONST };
+
+struct Symbol {
+  SymKind kind;
+  uint32_t value;
+};
+
+// An instruction waiting for its symbolic operands to be resolved
+struct PendingInsn {
+  string mnemonic;
+  vector<string> args;
+  SourcePos pos;
+};
+
+// A data word whose value is a symbol
+struct DataFixup {
+  bool kernel;
+  uint32_t offset;
+  string expr;
+  SourcePos pos;
+};
+
+class Machine {
+ public:
+  Machine() : ktext_addr(KTEXT_BASE), errors(0) {}
+
+  ~Machine() { free(stack); }
+
+  bool assemble(const string& filename);
+
+  bool link();
+
+  int run();
+
+ private:
+  enum Segment { SEG_TEXT, SEG_KTEXT, SEG_DATA, SEG_KDATA };
+
+  // assembler
+  void error(const SourcePos& pos, const string& msg);
+
+  void assemble_line(string line, const SourcePos& pos, Segment& seg);
+
+  void directive(const string& name, const string& rest,
+                 const SourcePos& pos, Segment& seg);
+
+  void define_label(const string& name, Segment seg, const SourcePos& pos);
+
+  // the labels of file first, then the global ones
+  bool lookup(const string& expr, const string* file, uint32_t& value);
+
+  bool eval(const string& expr, const SourcePos& pos, uint32_t& value);
+
+  int reg(const string& name, const SourcePos& pos);
+
+  bool is_reg(const string& s) { return !s.empty() && s[0] == '$'; }
+
+  void encode(const PendingInsn& p, Insn& insn);
+
+  // memory
+  uint8_t* mem(uint32_t addr, uint32_t size) {
+    uint32_t off = addr - DATA_BASE;
+    if (off < data.size() && data.size() - off >= size) {
+      return &data[off];
+    }
+    off = addr - STACK_BASE;
+    if (off < STACK_SIZE && STACK_SIZE - off >= size) { return stack + off; }
+    off = addr - KDATA_BASE;
+    if (off < kdata.size() && kdata.size() - off >= size) {
+      return &kdata[off];
+    }
+    return nullptr;
+  }
+
+  uint32_t address_of(uint32_t index) {
+    return index < ntext ? TEXT_BASE + 4 * index
+                         : ktext_addr + 4 * (index - ntext);
+  }
+
+  bool index_of(uint32_t addr, uint32_t& index) {
+    if (addr & 3) { return false; }
+    if (addr - TEXT_BASE < 4 * ntext) {
+      index = (addr - TEXT_BASE) / 4;
+      return true;
+    }
+    if (addr - ktext_addr < 4 * (code.size() - ntext)) {
+      index = ntext + (addr - ktext_addr) / 4;
+      return true;
+    }
+    return false;
+  }
+
+  void sbrk(uint32_t bytes) {
+    bytes = (bytes + 3) & ~3u;
+    if (data.size() + bytes > MAX_DATA) { return; }
+    data.resize(data.size() + bytes);
+  }
+
+  bool syscall(uint32_t R[], int& exit_code);
+
+  bool read_line(char* buf, uint32_t size);
+
+  vector<PendingInsn> text_src, ktext_src;
+  vector<DataFixup> fixups;
+  map<string, Symbol> symbols;                 // global labels, constants
+  map<const string*, map<string, Symbol>> labels;  // the labels of each file
+  set<string> globls;                          // in the file being assembled
+  vector<uint8_t> data, kdata;
+  vector<Insn> code;
+  uint32_t ntext;
+  uint32_t ktext_addr;
+  uint8_t* stack;
+  int errors;
+};
+
+//
+// Assembler
+//
+
+void Machine::error(const SourcePos& pos, const string& msg) {
+  cerr << *pos.file << ":" << pos.line << ": " << msg << endl;
+  errors++;
+}
+
+bool Machine::assemble(const string& filename) {
+  std::ifstream in(filename.c_str());
+  if (!in) {
+    cerr << "Cannot open file: `" << filename << "'" << endl;
+    return false;
+  }
+  const string* file = new string(filename);
+  globls.clear();
+  Segment seg = SEG_TEXT;
+  string line;
+  SourcePos pos = {file, 0};
+  while (std::getline(in, line)) {
+    pos.line++;
+    assemble_line(line, pos, seg);
+  }
+  // The labels declared .globl are seen from the other files
+  for (auto& name : globls) {
+    auto iter = labels[file].find(name);
+    if (iter == labels[file].end()) { continue; }
+    if (symbols.count(name)) {
+      cerr << filename << ": label is defined for the second time: " << name << endl;
+      errors++;
+    }
+    symbols[name] = iter->second;
+  }
+  return errors == 0;
+}
+
+// Split off the first whitespace or comma separated word of s
+static string next_word(const string& s, size_t& i) {
+  while (i < s.size() && (isspace(s[i]) || s[i] == ',')) { i++; }
+  size_t start = i;
+  while (i < s.size() && !isspace(s[i]) && s[i] != ',') { i++; }
+  return s.substr(start, i - start);
+}
+
+static bool is_symbol_char(char c) {
+  return isalnum(c) || c == '_' || c == '.' || c == '$';
+}
+
+void Machine::assemble_line(string line, const SourcePos& pos, Segment& seg) {
+  // strip the comment, but not a '#' inside a string
+  bool quoted = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    if (quoted && line[i] == '\\') {
+      i++;
+    } else if (line[i] == '"') {
+      quoted = !quoted;
+    } else if (!quoted && line[i] == '#') {
+      line.resize(i);
+      break;
+    }
+  }
+
+  size_t i = 0;
+  for (;;) {
+    while (i < line.size() && isspace(line[i])) { i++; }
+    if (i == line.size()) { return; }
+    size_t start = i;
+    while (i < line.size() && is_symbol_char(line[i])) { i++; }
+    string word = line.substr(start, i - start);
+    size_t j = i;
+    while (j < line.size() && isspace(line[j])) { j++; }
+    if (!word.empty() && j < line.size() && line[j] == ':') {
+      define_label(word, seg, pos);
+      i = j + 1;
+      continue;
+    }
+    if (!word.empty() && j < line.size() && line[j] == '=') {
+      uint32_t value;
+      if (eval(line.substr(j + 1), pos, value)) {
+        Symbol sym = {SYM_CONST, value};
+        symbols[word] = sym;
+      }
+      return;
+    }
+    if (word.empty()) {
+      error(pos, "syntax error");
+      return;
+    }
+    if (word[0] == '.') {
+      directive(word, line.substr(i), pos, seg);
+      return;
+    }
+    if (seg != SEG_TEXT && seg != SEG_KTEXT) {
+      error(pos, "instruction in data segment: " + word);
+      return;
+    }
+    PendingInsn p;
+    p.mnemonic = word;
+    p.pos = pos;
+    for (;;) {
+      string arg = next_word(line, i);
+      if (arg.empty()) { break; }
+      p.args.push_back(arg);
+    }
+    (seg == SEG_TEXT ? text_src : ktext_src).push_back(p);
+    return;
+  }
+}
+
+void Machine::define_label(const string& name, Segment seg,
+                           const SourcePos& pos) {
+  if (labels[pos.file].count(name)) {
+    error(pos, "label is defined for the second time: " + name);
+    return;
+  }
+  Symbol sym;
+  switch (seg) {
+    case SEG_TEXT: sym.kind = SYM_TEXT; sym.value = text_src.size(); break;
+    case SEG_KTEXT: sym.kind = SYM_KTEXT; sym.value = ktext_src.size(); break;
+    case SEG_DATA: sym.kind = SYM_DATA; sym.value = data.size(); break;
+    case SEG_KDATA: sym.kind = SYM_KDATA; sym.value = kdata.size(); break;
+  }
+  labels[pos.file][name] = sym;
+}
+
+static void append_word(vector<uint8_t>& seg, uint32_t w) {
+  size_t n = seg.size();
+  seg.resize(n + 4);
+  memcpy(&seg[n], &w, 4);
+}
+
+void Machine::directive(const string& name, const string& rest,
+                        const SourcePos& pos, Segment& seg) {
+  size_t i = 0;
+  if (name == ".text") {
+    seg = SEG_TEXT;
+  } else if (name == ".data") {
+    seg = SEG_DATA;
+  } else if (name == ".ktext") {
+    seg = SEG_KTEXT;
+    uint32_t addr;
+    string arg = next_word(rest, i);
+    if (!arg.empty() && eval(arg, pos, addr) && ktext_src.empty()) {
+      ktext_addr = addr;
+    }
+  } else if (name == ".kdata") {
+    seg = SEG_KDATA;
+  } else if (name == ".globl") {
+    globls.insert(next_word(rest, i));
+  } else if (name == ".set" || name == ".extern") {
+    // nothing to do: there is no reordering
+  } else if (seg != SEG_DATA && seg != SEG_KDATA) {
+    error(pos, "directive not supported in text segment: " + name);
+  } else {
+    auto& bytes = seg == SEG_DATA ? data : kdata;
+    if (name == ".align") {
+      uint32_t n;
+      if (eval(next_word(rest, i), pos, n)) {
+        while (bytes.size() % (1u << n)) { bytes.push_back(0); }
+      }
+    } else if (name == ".word") {
+      while (bytes.size() % 4) { bytes.push_back(0); }
+      for (;;) {
+        string arg = next_word(rest, i);
+        if (arg.empty()) { break; }
+        uint32_t value = 0;
+        if (!lookup(arg, pos.file, value)) {
+          DataFixup f = {seg == SEG_KDATA, (uint32_t) bytes.size(), arg, pos};
+          fixups.push_back(f);
+        }
+        append_word(bytes, value);
+      }
+    } else if (name == ".byte") {
+      for (;;) {
+        string arg = next_word(rest, i);
+        if (arg.empty()) { break; }
+        uint32_t value;
+        if (eval(arg, pos, value)) { bytes.push_back(value); }
+      }
+    } else if (name == ".space") {
+      uint32_t n;
+      if (eval(next_word(rest, i), pos, n)) { bytes.resize(bytes.size() + n); }
+    } else if (name == ".ascii" || name == ".asciiz") {
+      size_t q = rest.find('"');
+      if (q == string::npos) {
+        error(pos, "missing string");
+        return;
+      }
+      for (q++; q < rest.size() && rest[q] != '"'; q++) {
+        char c = rest[q];
+        if (c == '\\' && q + 1 < rest.size()) {
+          switch (rest[++q]) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case '0': c = '\0'; break;
+            default: c = rest[q]; break;
+          }
+        }
+        bytes.push_back(c);
+      }
+      if (name == ".asciiz") { bytes.push_back(0); }
+    } else {
+      error(pos, "unknown directive: " + name);
+    }
+  }
+}
+
+// Look up a symbol or number, optionally followed by +n or -n
+bool Machine::lookup(const string& expr, const string* file, uint32_t& value) {
+  if (expr.empty()) { return false; }
+  if (isdigit(expr[0]) || expr[0] == '-' || expr[0] == '+') {
+    char* end;
+    value = (uint32_t) strtoll(expr.c_str(), &end, 0);
+    return *end == 0;
+  }
+  size_t k = 1;
+  while (k < expr.size() && expr[k] != '+' && expr[k] != '-') { k++; }
+  auto name = expr.substr(0, k);
+  auto& local = labels[file];
+  auto iter = local.find(name);
+  if (iter == local.end()) {
+    iter = symbols.find(name);
+    if (iter == symbols.end()) { return false; }
+  }
+  uint32_t addend = 0;
+  if (k < expr.size() && !lookup(expr.substr(k), file, addend)) { return false; }
+  const Symbol& sym = iter->second;
+  switch (sym.kind) {
+    case SYM_TEXT: value = TEXT_BASE + 4 * sym.value; break;
+    case SYM_KTEXT: value = ktext_addr + 4 * sym.value; break;
+    case SYM_DATA: value = DATA_BASE + sym.value; break;
+    case SYM_KDATA: value = KDATA_BASE + sym.value; break;
+    case SYM_CONST: value = sym.value; break;
+  }
+  value += addend;
+  return true;
+}
+
+bool Machine::eval(const string& expr, const SourcePos& pos, uint32_t& value) {
+  size_t i = 0;
+  string word = next_word(expr, i);
+  if (!lookup(word, pos.file, value)) {
+    error(pos, "undefined symbol or bad number: " + word);
+    return false;
+  }
+  return true;
+}
+
+int Machine::reg(const string& name, const SourcePos& pos) {
+  static const char* names[] = {
+      "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+      "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+      "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+      "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"};
+  if (is_reg(name)) {
+    string r = name.substr(1);
+    if (!r.empty() && isdigit(r[0])) {
+      int n = atoi(r.c_str());
+      if (n >= 0 && n < 32) { return n; }
+    }
+    for (int n = 0; n < 32; n++) {
+      if (r == names[n]) { return n; }
+    }
+    if (r == "s8") { return 30; }
+  }
+  error(pos, "bad register: " + name);
+  return 0;
+}
+
+bool Machine::link() {
+  // Each segment is followed by a guard slot: running off the end of
+  // the code is an error.
+  ntext = text_src.size() + 1;
+  code.resize(ntext + ktext_src.size() + 1);
+  for (uint32_t i = 0; i + 1 < ntext; i++) {
+    encode(text_src[i], code[i]);
+  }
+  for (uint32_t i = 0; i < ktext_src.size(); i++) {
+    encode(ktext_src[i], code[ntext + i]);
+  }
+  code[ntext - 1].op = OP_FALLOFF;
+  code.back().op = OP_FALLOFF;
+
+  for (auto& f : fixups) {
+    uint32_t value;
+    if (!lookup(f.expr, f.pos.file, value)) {
+      error(f.pos, "undefined symbol: " + f.expr);
+      continue;
+    }
+    memcpy(&(f.kernel ? kdata : data)[f.offset], &value, 4);
+  }
+  if (!symbols.count("__start")) {
+    cerr << "The following symbols are undefined:\n__start" << endl;
+    errors++;
+  }
+  text_src.clear();
+  ktext_src.clear();
+  return errors == 0;
+}
+
+struct Mnemonic {
+  uint8_t op;
+  enum Form {
+    ALU,        // op rd rs (rt|imm), or op rd (rt|imm)
+    ALU_IMM,    // op rt rs imm: the I-type instructions
+    UNARY,      // op rd rs
+    LOAD_IMM,   // op rd imm
+    MEM,        // op rt address
+    BRANCH2,    // op rs (rt|imm) label
+    BRANCH1,    // op rs label: compare with zero
+    JUMP,       // op label
+    JUMP_REG,   // op rs
+    JUMP_LINK,  // op [rd] rs
+    HILO,       // op rs rt
+    MOVE_HILO,  // op rd
+    MOVE_TO_HILO, // op rs
+    COP0,       // op rt $n
+    NONE
+  } form;
+  uint8_t alt;  // OP_DIV with two registers means DIVHL, etc.
+};
+
+const map<string, Mnemonic>& mnemonics() {
+  static map<string, Mnemonic> table;
+  if (!table.empty()) { return table; }
+  typedef Mnemonic M;
+#define X(n) table[#n] = M{OP_##n, M::ALU, 0};
+  COOLRUN_ALU_OPS(X)
+#undef X
+#define X(n) table[#n] = M{OP_##n, M::BRANCH2, 0};
+  COOLRUN_BRANCH_OPS(X)
+#undef X
+  // spim mnemonics are lower case
+  map<string, Mnemonic> lower;
+  for (auto& kv : table) {
+    string name = kv.first;
+    for (auto& c : name) { c = tolower(c); }
+    lower[name] = kv.second;
+  }
+  table.swap(lower);
+  table["sllv"] = M{OP_SLL, M::ALU, 0};
+  table["srlv"] = M{OP_SRL, M::ALU, 0};
+  table["srav"] = M{OP_SRA, M::ALU, 0};
+  table["mulou"] = M{OP_MUL, M::ALU, 0};
+  table["div"].alt = OP_DIVHL;
+  table["divu"].alt = OP_DIVUHL;
+  table["addi"] = M{OP_ADD_I, M::ALU_IMM, 0};
+  table["addiu"] = M{OP_ADDU_I, M::ALU_IMM, 0};
+  table["andi"] = M{OP_AND_I, M::ALU_IMM, 0};
+  table["ori"] = M{OP_OR_I, M::ALU_IMM, 0};
+  table["xori"] = M{OP_XOR_I, M::ALU_IMM, 0};
+  table["slti"] = M{OP_SLT_I, M::ALU_IMM, 0};
+  table["sltiu"] = M{OP_SLTU_I, M::ALU_IMM, 0};
+  table["beqz"] = M{OP_BEQ_I, M::BRANCH1, 0};
+  table["bnez"] = M{OP_BNE_I, M::BRANCH1, 0};
+  table["bltz"] = M{OP_BLT_I, M::BRANCH1, 0};
+  table["blez"] = M{OP_BLE_I, M::BRANCH1, 0};
+  table["bgtz"] = M{OP_BGT_I, M::BRANCH1, 0};
+  table["bgez"] = M{OP_BGE_I, M::BRANCH1, 0};
+  table["move"] = M{OP_MOVE, M::UNARY, 0};
+  table["neg"] = M{OP_NEG, M::UNARY, 0};
+  table["negu"] = M{OP_NEGU, M::UNARY, 0};
+  table["not"] = M{OP_NOT, M::UNARY, 0};
+  table["abs"] = M{OP_ABS, M::UNARY, 0};
+  table["li"] = M{OP_LI, M::LOAD_IMM, 0};
+  table["la"] = M{OP_LI, M::LOAD_IMM, 0};
+  table["lui"] = M{OP_LUI, M::LOAD_IMM, 0};
+  table["mult"] = M{OP_MULT, M::HILO, 0};
+  table["multu"] = M{OP_MULTU, M::HILO, 0};
+  table["mfhi"] = M{OP_MFHI, M::MOVE_HILO, 0};
+  table["mflo"] = M{OP_MFLO, M::MOVE_HILO, 0};
+  table["mthi"] = M{OP_MTHI, M::MOVE_TO_HILO, 0};
+  table["mtlo"] = M{OP_MTLO, M::MOVE_TO_HILO, 0};
+  table["lw"] = M{OP_LW, M::MEM, 0};
+  table["lh"] = M{OP_LH, M::MEM, 0};
+  table["lhu"] = M{OP_LHU, M::MEM, 0};
+  table["lb"] = M{OP_LB, M::MEM, 0};
+  table["lbu"] = M{OP_LBU, M::MEM, 0};
+  table["sw"] = M{OP_SW, M::MEM, 0};
+  table["sh"] = M{OP_SH, M::MEM, 0};
+  table["sb"] = M{OP_SB, M::MEM, 0};
+  table["b"] = M{OP_B, M::JUMP, 0};
+  table["j"] = M{OP_B, M::JUMP, 0};
+  table["jal"] = M{OP_JAL, M::JUMP, 0};
+  table["jr"] = M{OP_JR, M::JUMP_REG, 0};
+  table["jalr"] = M{OP_JALR, M::JUMP_LINK, 0};
+  table["syscall"] = M{OP_SYSCALL, M::NONE, 0};
+  table["break"] = M{OP_BREAK, M::NONE, 0};
+  table["nop"] = M{OP_NOP, M::NONE, 0};
+  table["rfe"] = M{OP_RFE, M::NONE, 0};
+  table["mfc0"] = M{OP_MFC0, M::COP0, 0};
+  table["mtc0"] = M{OP_MTC0, M::COP0, 0};
+  return table;
+}
+
+void Machine::encode(const PendingInsn& p, Insn& insn) {
+  insn.op = OP_NOP;
+  insn.rd = insn.rs = insn.rt = 0;
+  insn.imm = 0;
+  insn.target = 0;
+
+  auto iter = mnemonics().find(p.mnemonic);
+  if (iter == mnemonics().end()) {
+    error(p.pos, "unknown instruction: " + p.mnemonic);
+    return;
+  }
+  const Mnemonic& m = iter->second;
+  const vector<string>& a = p.args;
+  size_t expected = 0;
+  uint32_t value = 0;
+
+  // the value of an immediate operand
+  auto imm = [&](const string& s) -> int32_t {
+    if (!lookup(s, p.pos.file, value)) { error(p.pos, "undefined symbol: " + s); }
+    return (int32_t) value;
+  };
+  // the index of the instruction at label s
+  auto target = [&](const string& s) -> uint32_t {
+    uint32_t t = 0;
+    if (!lookup(s, p.pos.file, value) || !index_of(value, t)) {
+      error(p.pos, "bad branch target: " + s);
+    }
+    return t;
+  };
+
+  insn.op = m.op;
+  switch (m.form) {
+    case Mnemonic::ALU:
+      if (a.size() == 2 && m.alt && is_reg(a[1])) {
+        // div rs rt: the real instruction writing hi and lo
+        insn.op = m.alt;
+        insn.rs = reg(a[0], p.pos);
+        insn.rt = reg(a[1], p.pos);
+        expected = 2;
+        break;
+      }
+      if (a.size() < 2) { break; }
+      expected = a.size() == 2 ? 2 : 3;
+      insn.rd = reg(a[0], p.pos);
+      insn.rs = a.size() == 2 ? insn.rd : reg(a[1], p.pos);
+      if (is_reg(a[expected - 1])) {
+        insn.rt = reg(a[expected - 1], p.pos);
+      } else {
+        insn.op++;
+        insn.imm = imm(a[expected - 1]);
+      }
+      break;
+    case Mnemonic::ALU_IMM:
+      if (a.size() < 2) { break; }
+      expected = a.size() == 2 ? 2 : 3;
+      insn.rd = reg(a[0], p.pos);
+      insn.rs = a.size() == 2 ? insn.rd : reg(a[1], p.pos);
+      insn.imm = imm(a[expected - 1]);
+      break;
+    case Mnemonic::UNARY:
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rd = reg(a[0], p.pos);
+      insn.rs = reg(a[1], p.pos);
+      break;
+    case Mnemonic::LOAD_IMM:
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rd = reg(a[0], p.pos);
+      insn.imm = imm(a[1]);
+      break;
+    case Mnemonic::MEM: {
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rt = reg(a[0], p.pos);
+      // offset, (rs), offset(rs), symbol, symbol(rs)
+      string addr = a[1];
+      size_t paren = addr.find('(');
+      if (paren != string::npos) {
+        size_t close = addr.find(')', paren);
+        insn.rs = reg(addr.substr(paren + 1, close - paren - 1), p.pos);
+        addr = addr.substr(0, paren);
+      }
+      insn.imm = addr.empty() ? 0 : imm(addr);
+      break;
+    }
+    case Mnemonic::BRANCH2:
+      expected = 3;
+      if (a.size() < 3) { break; }
+      insn.rs = reg(a[0], p.pos);
+      if (is_reg(a[1])) {
+        insn.rt = reg(a[1], p.pos);
+      } else {
+        insn.op++;
+        insn.imm = imm(a[1]);
+      }
+      insn.target = target(a[2]);
+      break;
+    case Mnemonic::BRANCH1:
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rs = reg(a[0], p.pos);
+      insn.target = target(a[1]);
+      break;
+    case Mnemonic::JUMP:
+      expected = 1;
+      if (a.size() < 1) { break; }
+      insn.target = target(a[0]);
+      break;
+    case Mnemonic::JUMP_REG:
+      expected = 1;
+      if (a.size() < 1) { break; }
+      insn.rs = reg(a[0], p.pos);
+      break;
+    case Mnemonic::JUMP_LINK:
+      expected = a.size() == 2 ? 2 : 1;
+      if (a.size() < 1) { break; }
+      insn.rd = a.size() == 2 ? reg(a[0], p.pos) : 31;
+      insn.rs = reg(a.back(), p.pos);
+      break;
+    case Mnemonic::HILO:
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rs = reg(a[0], p.pos);
+      insn.rt = reg(a[1], p.pos);
+      break;
+    case Mnemonic::MOVE_HILO:
+      expected = 1;
+      if (a.size() < 1) { break; }
+      insn.rd = reg(a[0], p.pos);
+      break;
+    case Mnemonic::MOVE_TO_HILO:
+      expected = 1;
+      if (a.size() < 1) { break; }
+      insn.rs = reg(a[0], p.pos);
+      break;
+    case Mnemonic::COP0:
+      expected = 2;
+      if (a.size() < 2) { break; }
+      insn.rt = reg(a[0], p.pos);
+      insn.rd = reg(a[1], p.pos);
+      break;
+    case Mnemonic::NONE:
+      // break may carry a code, which is ignored
+      expected = a.size();
+      break;
+  }
+  if (a.size() != expected) {
+    error(p.pos, "wrong number of operands: " + p.mnemonic);
+    insn.op = OP_NOP;
+  }
+
+  // Writes to $zero are dropped, so the interpreter never has to
+  // restore it.
+  bool writes_rd = m.form == Mnemonic::ALU || m.form == Mnemonic::ALU_IMM ||
+                   m.form == Mnemonic::UNARY || m.form == Mnemonic::LOAD_IMM ||
+                   m.form == Mnemonic::MOVE_HILO;
+  if (writes_rd && insn.rd == 0 && insn.op != OP_DIVHL &&
+      insn.op != OP_DIVUHL) {
+    insn.op = OP_NOP;
+  }
+  if (m.form == Mnemonic::MEM && insn.rt == 0 && insn.op >= OP_LW &&
+      insn.op <= OP_LBU) {
+    insn.op = OP_NOP;
+  }
+}
+
+//
+// Simulation
+//
+
+bool Machine::read_line(char* buf, uint32_t size) {
+  fflush(stdout);
+  uint32_t n = 0;
+  int c = EOF;
+  while (n + 1 < size && (c = getchar()) != EOF) {
+    buf[n++] = c;
+    if (c == '\n') { break; }
+  }
+  buf[n] = 0;
+  return n > 0 || c != EOF;
+}
+
+// Returns false when the program exits.
+bool Machine::syscall(uint32_t R[], int& exit_code) {
+  const int V0 = 2, A0 = 4, A1 = 5, A2 = 6;
+  switch (R[V0]) {
+    case 1:   // print_int
+      printf("%d", (int32_t) R[A0]);
+      return true;
+    case 4: { // print_str
+      uint8_t* p;
+      for (uint32_t a = R[A0]; (p = mem(a, 1)) && *p; a++) {
+        putchar(*p);
+      }
+      return true;
+    }
+    case 5: { // read_int
+      char buf[256];
+      read_line(buf, sizeof(buf));
+      R[V0] = (uint32_t) atol(buf);
+      return true;
+    }
+    case 8: { // read_string
+      uint32_t size = R[A1];
+      uint8_t* p = size ? mem(R[A0], size) : nullptr;
+      if (p) { read_line((char*) p, size); }
+      return true;
+    }
+    case 9: { // sbrk
+      uint32_t old = DATA_BASE + data.size();
+      sbrk(R[A0]);
+      R[V0] = old;
+      return true;
+    }
+    case 10:  // exit
+      exit_code = 0;
+      return false;
+    case 11:  // print_char
+      putchar(R[A0]);
+      return true;
+    case 12: { // read_char
+      fflush(stdout);
+      R[V0] = getchar();
+      return true;
+    }
+    case 14: { // read(fd, buf, len), a line at a time from stdin
+      uint32_t size = R[A2];
+      uint8_t* p = size ? mem(R[A1], size) : nullptr;
+      if (R[A0] != 0 || !p) {
+        R[V0] = (uint32_t) -1;
+        return true;
+      }
+      fflush(stdout);
+      uint32_t n = 0;
+      int c;
+      while (n < size && (c = getchar()) != EOF) {
+        p[n++] = c;
+        if (c == '\n') { break; }
+      }
+      R[V0] = n;
+      return true;
+    }
+    case 15: { // write(fd, buf, len)
+      uint32_t size = R[A2];
+      uint8_t* p = size ? mem(R[A1], size) : nullptr;
+      FILE* out = R[A0] == 1 ? stdout : R[A0] == 2 ? stderr : nullptr;
+      if (size && (!p || !out)) {
+        R[V0] = (uint32_t) -1;
+        return true;
+      }
+      if (out == stderr) { fflush(stdout); }
+      R[V0] = size ? fwrite(p, 1, size, out) : 0;
+      return true;
+    }
+    case 17:  // exit2
+      exit_code = R[A0];
+      return false;
+    default:
+      exit_code = -1;
+      return true;
+  }
+}
+
+int Machine::run() {
+  stack = (uint8_t*) calloc(STACK_SIZE, 1);
+  // heap space between the static data and the program break
+  size_t static_end = (data.size() + 4095) & ~(size_t) 4095;
+  data.resize(static_end + INITIAL_HEAP);
+
+  uint32_t R[32] = {0};
+  uint32_t hi = 0, lo = 0;
+  uint32_t cop0[32] = {0};
+  const int SP = 29, GP = 28, RA = 31, CAUSE = 13, EPC = 14;
+  R[SP] = INITIAL_SP;
+  R[GP] = 0x10008000;
+
+  static const void* labels[] = {
+#define X(n) &&L_##n, &&L_##n##_I,
+      COOLRUN_ALU_OPS(X)
+      COOLRUN_BRANCH_OPS(X)
+#undef X
+#define X(n) &&L_##n,
+      COOLRUN_OTHER_OPS(X)
+#undef X
+  };
+  for (auto& insn : code) { insn.handler = labels[insn.op]; }
+
+  uint32_t handler_index;
+  bool have_handler = index_of(KTEXT_BASE, handler_index);
+  uint32_t start;
+  lookup("__start", nullptr, start);
+  const Insn* base = code.data();
+  const Insn* ip = base;
+  index_of(start, start);
+  ip = base + start;
+  int exc = 0;
+  int exit_code = 0;
+  uint32_t a, b, addr;
+  uint8_t* p;
+
+#define NEXT do { ++ip; goto *ip->handler; } while (0)
+#define JUMP(index) do { ip = base + (index); goto *ip->handler; } while (0)
+#define RAISE(code) do { exc = (code); goto exception; } while (0)
+
+  goto *ip->handler;
+
+#define ALU(NAME, EXPR) \
+  L_##NAME: a = R[ip->rs]; b = R[ip->rt]; EXPR; NEXT; \
+  L_##NAME##_I: a = R[ip->rs]; b = ip->imm; EXPR; NEXT;
+
+  // overflow is detected like the hardware does: on the sign bits
+  ALU(ADD, { uint32_t r = a + b;
+             if (~(a ^ b) & (a ^ r) & 0x80000000) { RAISE(EXC_OVF); }
+             R[ip->rd] = r; })
+  ALU(ADDU, R[ip->rd] = a + b)
+  ALU(SUB, { uint32_t r = a - b;
+             if ((a ^ b) & (a ^ r) & 0x80000000) { RAISE(EXC_OVF); }
+             R[ip->rd] = r; })
+  ALU(SUBU, R[ip->rd] = a - b)
+  ALU(AND, R[ip->rd] = a & b)
+  ALU(OR, R[ip->rd] = a | b)
+  ALU(XOR, R[ip->rd] = a ^ b)
+  ALU(NOR, R[ip->rd] = ~(a | b))
+  ALU(SLT, R[ip->rd] = (int32_t) a < (int32_t) b)
+  ALU(SLTU, R[ip->rd] = a < b)
+  ALU(SGT, R[ip->rd] = (int32_t) a > (int32_t) b)
+  ALU(SGTU, R[ip->rd] = a > b)
+  ALU(SGE, R[ip->rd] = (int32_t) a >= (int32_t) b)
+  ALU(SGEU, R[ip->rd] = a >= b)
+  ALU(SLE, R[ip->rd] = (int32_t) a <= (int32_t) b)
+  ALU(SLEU, R[ip->rd] = a <= b)
+  ALU(SEQ, R[ip->rd] = a == b)
+  ALU(SNE, R[ip->rd] = a != b)
+  ALU(SLL, R[ip->rd] = a << (b & 31))
+  ALU(SRL, R[ip->rd] = a >> (b & 31))
+  ALU(SRA, R[ip->rd] = (uint32_t) ((int32_t) a >> (b & 31)))
+  ALU(MUL, R[ip->rd] = (uint32_t) ((int64_t) (int32_t) a * (int32_t) b))
+  ALU(DIV, { if (b == 0) { RAISE(EXC_BKPT); }
+             R[ip->rd] = (a == 0x80000000 && b == 0xffffffff)
+                 ? a : (uint32_t) ((int32_t) a / (int32_t) b); })
+  ALU(DIVU, { if (b == 0) { RAISE(EXC_BKPT); } R[ip->rd] = a / b; })
+  ALU(REM, { if (b == 0) { RAISE(EXC_BKPT); }
+             R[ip->rd] = (b == 0xffffffff)
+                 ? 0 : (uint32_t) ((int32_t) a % (int32_t) b); })
+  ALU(REMU, { if (b == 0) { RAISE(EXC_BKPT); } R[ip->rd] = a % b; })
+#undef ALU
+
+#define BRANCH(NAME, COND) \
+  L_##NAME: a = R[ip->rs]; b = R[ip->rt]; \
+    if (COND) { JUMP(ip->target); } NEXT; \
+  L_##NAME##_I: a = R[ip->rs]; b = ip->imm; \
+    if (COND) { JUMP(ip->target); } NEXT;
+
+  BRANCH(BEQ, a == b)
+  BRANCH(BNE, a != b)
+  BRANCH(BLT, (int32_t) a < (int32_t) b)
+  BRANCH(BLE, (int32_t) a <= (int32_t) b)
+  BRANCH(BGT, (int32_t) a > (int32_t) b)
+  BRANCH(BGE, (int32_t) a >= (int32_t) b)
+  BRANCH(BLTU, a < b)
+  BRANCH(BLEU, a <= b)
+  BRANCH(BGTU, a > b)
+  BRANCH(BGEU, a >= b)
+#undef BRANCH
+
+  L_MOVE: R[ip->rd] = R[ip->rs]; NEXT;
+  L_NEG:
+    a = R[ip->rs];
+    if (a == 0x80000000) { RAISE(EXC_OVF); }
+    R[ip->rd] = -a;
+    NEXT;
+  L_NEGU: R[ip->rd] = -R[ip->rs]; NEXT;
+  L_NOT: R[ip->rd] = ~R[ip->rs]; NEXT;
+  L_ABS:
+    a = R[ip->rs];
+    R[ip->rd] = (int32_t) a < 0 ? -a : a;
+    NEXT;
+  L_LI: R[ip->rd] = ip->imm; NEXT;
+  L_LUI: R[ip->rd] = (uint32_t) ip->imm << 16; NEXT;
+  L_MULT: {
+    int64_t r = (int64_t) (int32_t) R[ip->rs] * (int32_t) R[ip->rt];
+    lo = (uint32_t) r;
+    hi = (uint32_t) (r >> 32);
+    NEXT;
+  }
+  L_MULTU: {
+    uint64_t r = (uint64_t) R[ip->rs] * R[ip->rt];
+    lo = (uint32_t) r;
+    hi = (uint32_t) (r >> 32);
+    NEXT;
+  }
+  L_DIVHL:
+    a = R[ip->rs];
+    b = R[ip->rt];
+    // the hardware leaves hi and lo undefined on division by zero
+    if (b != 0 && !(a == 0x80000000 && b == 0xffffffff)) {
+      lo = (uint32_t) ((int32_t) a / (int32_t) b);
+      hi = (uint32_t) ((int32_t) a % (int32_t) b);
+    }
+    NEXT;
+  L_DIVUHL:
+    a = R[ip->rs];
+    b = R[ip->rt];
+    if (b != 0) {
+      lo = a / b;
+      hi = a % b;
+    }
+    NEXT;
+  L_MFHI: R[ip->rd] = hi; NEXT;
+  L_MFLO: R[ip->rd] = lo; NEXT;
+  L_MTHI: hi = R[ip->rs]; NEXT;
+  L_MTLO: lo = R[ip->rs]; NEXT;
+
+#define LOAD(NAME, SIZE, TYPE) \
+  L_##NAME: \
+    addr = R[ip->rs] + ip->imm; \
+    if (addr & (SIZE - 1)) { RAISE(EXC_ADDRL); } \
+    if (!(p = mem(addr, SIZE))) { RAISE(EXC_DBUS); } \
+    { TYPE v; memcpy(&v, p, SIZE); R[ip->rt] = (uint32_t) (int32_t) v; } \
+    NEXT;
+#define STORE(NAME, SIZE, TYPE) \
+  L_##NAME: \
+    addr = R[ip->rs] + ip->imm; \
+    if (addr & (SIZE - 1)) { RAISE(EXC_ADDRS); } \
+    if (!(p = mem(addr, SIZE))) { RAISE(EXC_DBUS); } \
+    { TYPE v = (TYPE) R[ip->rt]; memcpy(p, &v, SIZE); } \
+    NEXT;
+
+  LOAD(LW, 4, uint32_t)
+  LOAD(LH, 2, int16_t)
+  LOAD(LHU, 2, uint16_t)
+  LOAD(LB, 1, int8_t)
+  LOAD(LBU, 1, uint8_t)
+  STORE(SW, 4, uint32_t)
+  STORE(SH, 2, uint16_t)
+  STORE(SB, 1, uint8_t)
+#undef LOAD
+#undef STORE
+
+  L_B: JUMP(ip->target);
+  L_JAL:
+    R[RA] = address_of(ip - base + 1);
+    JUMP(ip->target);
+  L_JR:
+    if (!index_of(R[ip->rs], a)) { RAISE(EXC_IBUS); }
+    JUMP(a);
+  L_JALR:
+    if (!index_of(R[ip->rs], a)) { RAISE(EXC_IBUS); }
+    R[ip->rd] = address_of(ip - base + 1);
+    JUMP(a);
+  L_SYSCALL:
+    exit_code = 0;
+    if (!syscall(R, exit_code)) { goto done; }
+    if (exit_code) { RAISE(EXC_SYSCALL); }
+    NEXT;
+  L_BREAK: RAISE(EXC_BKPT);
+  L_MFC0: R[ip->rt] = cop0[ip->rd]; NEXT;
+  L_MTC0: cop0[ip->rd] = R[ip->rt]; NEXT;
+  L_RFE: NEXT;
+  L_NOP: NEXT;
+  L_FALLOFF:
+    fflush(stdout);
+    cerr << "Attempt to execute non-instruction at 0x" << std::hex
+         << address_of(ip - base) << std::dec << endl;
+    return 1;
+
+exception:
+  // Like spim: record the cause and the faulting instruction, then
+  // continue in the kernel's exception handler.
+  cop0[CAUSE] = exc << 2;
+  cop0[EPC] = address_of(ip - base);
+  if (!have_handler) {
+    fflush(stdout);
+    cerr << "Exception " << exc << " at 0x" << std::hex << cop0[EPC]
+         << std::dec << endl;
+    return 1;
+  }
+  JUMP(handler_index);
+
+done:
+  fflush(stdout);
+  return exit_code;
+#undef NEXT
+#undef JUMP
+#undef RAISE
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  string trap_file = TRAP_FILE;
+  vector<string> files;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if ((arg == "-trap_file" || arg == "-exception_file") && i + 1 < argc) {
+      trap_file = argv[++i];
+    } else if (arg == "-file" && i + 1 < argc) {
+      files.push_back(argv[++i]);
+    } else if (arg == "-notrap" || arg == "-noexception") {
+      trap_file.clear();
+    } else if (!arg.empty() && arg[0] == '-') {
+      cerr << "usage: " << argv[0]
+           << " [-trap_file <file>] [-notrap] [-file] <file.s>" << endl;
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  static char outbuf[1 << 16];
+  setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+
+  Machine machine;
+  if (!trap_file.empty() && !machine.assemble(trap_file)) { return 1; }
+  for (auto& f : files) {
+    if (!machine.assemble(f)) { return 1; }
+  }
+  if (!machine.link()) { return 1; }
+  return machine.run();
+}
@@ -1,5 +1,6 @@
 #include "emit.h"
 #include "cgen.h"
+#include "globals.h"
 
 
 char* gc_init_names[] =
@@ -90,7 +91,11 @@ void emit_disptable_ref(Symbol sym, ostream& s) { s << sym << DISPTAB_SUFFIX; }
 
 void emit_init_ref(Symbol sym, ostream& s) { s << sym << CLASSINIT_SUFFIX; }
 
-void emit_label_ref(int l, ostream& s) { s << "label" << l; }
+// Every class has a label space of its own, its class tag, so that the
+// labels do not depend on the order the classes are coded in
+void emit_label_ref(int l, ostream& s) {
+  s << "label" << Globals.get_label_space() << "_" << l;
+}
 
 void emit_protobj_ref(Symbol sym, ostream& s) { s << sym << PROTOBJ_SUFFIX; }
 
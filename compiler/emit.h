@@ -26,6 +26,11 @@
 #define BOOLTAG              "_bool_tag"
 #define STRINGTAG            "_string_tag"
 #define HEAP_START           "heap_start"
+#define STRCONSTEND          "_str_const_end"
+#define STRINTERNTAB         "_str_intern_tab"
+#define INTCACHE             "_int_cache"
+#define INTCACHEMIN          "_int_cache_min"
+#define INTCACHESIZE         "_int_cache_size"
 
 // Naming conventions
 #define DISPTAB_SUFFIX       "_dispTab"
@@ -42,6 +47,7 @@
 #define CASE_ABORT   "_case_abort"
 #define CASE_ABORT2  "_case_abort2"
 #define DISP_ABORT   "_dispatch_abort"
+#define INT_ALLOC    "_int_alloc"
 
 #define STR_ZERO             "0"
 #define EMPTY_STR            ""
@@ -67,6 +73,16 @@
 #define INT_SLOTS         1
 #define BOOL_SLOTS        1
 
+// Int values in [INT_CACHE_MIN, INT_CACHE_MAX] share preallocated objects
+#ifndef INT_CACHE_MIN
+#define INT_CACHE_MIN     -128
+#endif
+#ifndef INT_CACHE_MAX
+#define INT_CACHE_MAX     1023
+#endif
+// bytes between two cached Int objects, eyecatcher included
+#define INT_CACHE_STRIDE  ((DEFAULT_OBJFIELDS + INT_SLOTS + 1) * WORD_SIZE)
+
 #define GLOBAL        "\t.globl\t"
 #define ALIGN         "\t.align\t2\n"
 #define WORD          "\t.word\t"
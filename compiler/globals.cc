@@ -63,6 +63,9 @@ void globals_impl::initialize_constants(void) {
   substr = idtable.add_string("substr");
   type_name = idtable.add_string("type_name");
   val = idtable.add_string("_val");
+  // The file of the basic classes, added ahead of the strings of any
+  // program whether or not they are built first (see server.cc)
+  stringtable.add_string("<basic class>");
 }
 
 globals_impl::Location globals_impl::alloc_temp_loc() {
@@ -70,4 +73,11 @@ globals_impl::Location globals_impl::alloc_temp_loc() {
   return new_location(FP, temp_offset--);
 }
 
+thread_local SymbolTable<Symbol, globals_impl::Location> globals_impl::env;
+thread_local int globals_impl::max_temp;
+thread_local int globals_impl::temp_offset;
+thread_local int globals_impl::label_space;
+thread_local int globals_impl::label_index;
+thread_local Symbol globals_impl::current_class;
+
 globals_impl Globals;
@@ -78,6 +78,16 @@ class globals_impl {
     return current_class;
   }
 
+  // Labels are numbered anew in every label space, see emit_label_ref
+  void enter_label_space(int space) {
+    label_space = space;
+    label_index = 0;
+  }
+
+  int get_label_space() {
+    return label_space;
+  }
+
   int new_label() {
     return label_index++;
   }
@@ -94,38 +104,23 @@ class globals_impl {
     temp_offset++;
   }
 
-  void set_method_offset_for_class(
-      Symbol class_name,
-      Symbol method_name,
-      int offset) {
-    auto key = std::make_pair(class_name, method_name);
-    method_offset[key] = offset;
-  }
-
-  int get_method_offset_for_class(
-      Symbol class_name,
-      Symbol method_name
-  ) {
-    auto key = std::make_pair(class_name, method_name);
-    assert(method_offset.find(key) !=
-           method_offset.end());
-    return method_offset[key];
-  }
-
  public:
   map<Symbol, int> classtag, subclasstag_max;
-  SymbolTable<Symbol, Location> env;
+
+  // Classes are coded in parallel (see ClassTable::code_classes), so the
+  // state of coding one class belongs to the thread coding it
+  static thread_local SymbolTable<Symbol, Location> env;
 
   globals_impl() {
     initialize_constants();
   }
 
  private:
-  int max_temp;
-  int temp_offset;
-  int label_index = 0;
-  Symbol current_class;
-  map<pair<Symbol, Symbol>, int> method_offset;
+  static thread_local int max_temp;
+  static thread_local int temp_offset;
+  static thread_local int label_space;
+  static thread_local int label_index;
+  static thread_local Symbol current_class;
 
   // Initializing the predefined symbols.
   static void initialize_constants(void);
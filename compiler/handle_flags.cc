@@ -2,7 +2,9 @@
 #include <stdlib.h>
 #include "cool-io.h"
 #include <unistd.h>
+#include <string.h>
 #include "cgen.h"
+#include "timereport.h"
 
 //
 // coolc provides a debugging switch for each phase of the compiler,
@@ -12,11 +14,12 @@
 // All flags that can be set on the command line should be defined here;
 // otherwise, it is necessary to pollute test drivers for components of the
 // compiler with declarations of extern'ed debugging flags to satisfy the
-// linker.  The exceptions to this rule are yy_flex_debug and cool_yydebug, 
-// which are defined in files generated by flex and bison.
+// linker.  The exception to this rule is cool_yydebug, which is defined
+// in the file generated by bison.  The flex scanner is reentrant and has
+// a debug switch of its own, set from yy_flex_debug.
 //
 
-extern int yy_flex_debug;       // for the lexer; prints recognized rules
+int yy_flex_debug;              // for the lexer; prints recognized rules
 extern int cool_yydebug;        // for the parser
 
 int do_lexer;
@@ -27,9 +30,15 @@ int lex_verbose;         // also for the lexer; prints tokens
 int semant_debug;        // for semantic analysis
 int cgen_debug;          // for code gen
 bool disable_reg_alloc;  // Don't do register allocation
+int num_threads;         // threads for the parser, semant and cgen, 0 for one per hardware thread
 
 int cgen_optimize;       // optimize switch for code generator
 char* filename;      // file name for generated code
+char* cache_dir;     // directory caching the code of classes, or NULL
+char* ast_filename;  // file to save the AST to, or NULL
+int emit_units;      // write the code of each input file to a unit of its own
+int serve_requests;  // compile the requests read from stdin, see server.h
+TimeReport time_report;  // report the time and memory of each phase
 Memmgr cgen_Memmgr = GC_NOGC;      // enable/disable garbage collection
 Memmgr_Test cgen_Memmgr_Test = GC_NORMAL;  // normal/test GC
 Memmgr_Debug cgen_Memmgr_Debug = GC_QUICK; // check heap frequently
@@ -54,9 +63,19 @@ void handle_flags(int argc, char* argv[]) {
   cgen_debug = 0;
   cgen_optimize = 0;
   disable_reg_alloc = 0;
+  num_threads = 0;
+  // and the same for every request to a server
+  filename = NULL;
+  cache_dir = NULL;
+  ast_filename = NULL;
+  emit_units = 0;
+  serve_requests = 0;
+  time_report = TIME_REPORT_NONE;
+  cgen_Memmgr = GC_NOGC;
+  cgen_Memmgr_Test = GC_NORMAL;
+  cgen_Memmgr_Debug = GC_QUICK;
 
-
-  while ((c = getopt(argc, argv, "LPSlpscvrOo:gtT")) != -1) {
+  while ((c = getopt(argc, argv, "LPSlpscvrOo:gtTj:C:uif:A:")) != -1) {
     switch (c) {
       case 'L':
         do_lexer = 1;
@@ -100,6 +119,30 @@ void handle_flags(int argc, char* argv[]) {
       case 'O':  // enable optimization
         cgen_optimize = 1;
         break;
+      case 'j':  // number of threads
+        num_threads = atoi(optarg);
+        break;
+      case 'C':  // reuse the code of unchanged classes from this directory
+        cache_dir = optarg;
+        break;
+      case 'A':  // save the AST, parsed with -P or else type checked
+        ast_filename = optarg;
+        break;
+      case 'u':  // one assembly unit per input file, shared tables in -o
+        emit_units = 1;
+        break;
+      case 'i':  // serve compile requests
+        serve_requests = 1;
+        break;
+      case 'f':  // -ftime-report, or -ftime-report=json
+        if (strcmp(optarg, "time-report") == 0) {
+          time_report = TIME_REPORT_TEXT;
+        } else if (strcmp(optarg, "time-report=json") == 0) {
+          time_report = TIME_REPORT_JSON;
+        } else {
+          unknownopt = 1;
+        }
+        break;
       case '?':
         unknownopt = 1;
         break;
@@ -109,9 +152,12 @@ void handle_flags(int argc, char* argv[]) {
     }
   }
 
+  // The trace of -c only reads well from one thread
+  if (cgen_debug) { num_threads = 1; }
+
   if (unknownopt) {
     cerr << "usage: " << argv[0]
-         << " [-LPSlvpscOgtTr -o outname] [input-files]\n";
+         << " [-LPSlvpscOgtTrui -j threads -C cachedir -A astfile -o outname -ftime-report[=json]] [input-files]\n";
     exit(1);
   }
 
@@ -4,7 +4,8 @@
 #include "globals.h"
 #include "intermediate.h"
 
-extern char* curr_filename;
+extern thread_local char* curr_filename;
+extern ClassTable* classtable;
 
 using std::make_shared;
 using tac::Variable;
@@ -157,7 +158,7 @@ static Temporary dispatch_impl(
   // Call method
   sec.emit(label);
   // Get method offset in the dispatch table
-  int offset = Globals.get_method_offset_for_class(obj_type, name);
+  int offset = classtable->method_offset(obj_type, name);
   // Temporary to store dispatch address
   auto addr = TemporaryFactory::alloc();
   if (disp_type == DispatchType::STATIC) {
@@ -354,7 +355,7 @@ Temporary let_class::code(CodeSection& sec) {
   // If there is no init-expr
   // we initialize this object with its default value
   auto loc = VariableFactory::alloc();
-  if (typeid(*init) == typeid(no_expr_class)) {
+  if (init->get_kind() == no_expr_kind) {
     if (type_decl == Int) {
       sec.emit(New<tac::Assign>(
           loc, New<tac::StringConst>(
@@ -5,6 +5,7 @@
 #include <ostream>
 #include <string>
 #include <queue>
+#include <functional>
 #include "macros.h"
 #include "stringtab.h"
 
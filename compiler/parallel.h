@@ -0,0 +1,43 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+//
+// Runs independent pieces of work, such as the classes of a program,
+// on a pool of threads.  The number of threads is set with -j.
+//
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern int num_threads;  // -j: 0 for one per hardware thread
+
+// The number of threads to use for n pieces of work
+inline int worker_count(int n) {
+  int threads = num_threads;
+  if (threads <= 0) { threads = std::thread::hardware_concurrency(); }
+  if (threads > n) { threads = n; }
+  return threads < 1 ? 1 : threads;
+}
+
+// Calls work(i) for every i in [0, n), on worker_count(n) threads with
+// the calling thread among them, and returns when all calls did.  The
+// calls must not share mutable state.
+template<class Work>
+void parallel_for(int n, Work work) {
+  int threads = worker_count(n);
+  if (threads == 1) {
+    for (int i = 0; i < n; i++) { work(i); }
+    return;
+  }
+  std::atomic<int> next(0);
+  auto run = [&]() {
+    for (int i = next++; i < n; i = next++) { work(i); }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++) { pool.emplace_back(run); }
+  run();
+  for (auto& t: pool) { t.join(); }
+}
+
+#endif
@@ -1,13 +1,15 @@
 #include <stdlib.h>
-#include <typeinfo>
 #include <map>
 #include <set>
 #include <vector>
+#include <unordered_map>
 #include <iostream>
 #include "cool-tree.h"
 #include "symtab.h"
 #include "classtable.h"
 #include "globals.h"
+#include "parallel.h"
+#include "timereport.h"
 
 using std::fill;
 using std::pair;
@@ -16,20 +18,47 @@ using std::make_pair;
 
 
 extern int semant_debug;
-extern char* curr_filename;
+extern thread_local char* curr_filename;
 
 ClassTable* classtable;
 
 //
 // Environments for Type Checking, stands for O, M, C
 //
+// Classes are type checked on several threads, so O and C belong to
+// the thread checking the class; M is only read then.
+//
 
 // Record all Object IDs using provided ID table
-SymbolTable<Symbol, Entry*> ObjectIDs;
-// A global pointer to current class
-class__class* Current_Class;
+thread_local SymbolTable<Symbol, Entry*> ObjectIDs;
+// A pointer to current class
+thread_local class__class* Current_Class;
+
+// The methods a class defines itself, and the table of its parent for
+// the ones it inherits, so no class copies the methods of its ancestors
+struct MethodTable {
+  MethodTable* parent = nullptr;
+  std::unordered_map<Symbol, method_class*> own;
+
+  // The method name of this class, or NULL if there is none
+  method_class* lookup(Symbol name) const {
+    for (auto t = this; t; t = t->parent) {
+      auto iter = t->own.find(name);
+      if (iter != t->own.end()) { return iter->second; }
+    }
+    return NULL;
+  }
+};
+
 // Record methods of each class, key is class name
-map<Symbol, map<Symbol, pair<Formals, Symbol> > > Methods;
+std::unordered_map<Symbol, MethodTable> Methods;
+
+// The method name of class cls, or NULL.  Unlike Methods[cls] this does
+// not insert, so type checking threads may call it.
+method_class* lookup_method(Symbol cls, Symbol name) {
+  auto iter = Methods.find(cls);
+  return iter == Methods.end() ? NULL : iter->second.lookup(name);
+}
 
 //
 // Set proper type information for each type of node
@@ -105,7 +134,8 @@ void static_dispatch_class::type_check() {
   }
 
   // 3) Check if method is not defined
-  if (Methods[convert_type].find(this->name) == Methods[convert_type].end()) {
+  auto method = lookup_method(convert_type, this->name);
+  if (!method) {
     classtable->semant_error(Current_Class)
         << "Error: method \"" << this->name->get_string()
         << "\" of class \"" << convert_type->get_string()
@@ -114,8 +144,8 @@ void static_dispatch_class::type_check() {
     return;
   }
 
-  Formals formals = Methods[convert_type][this->name].first;
-  Symbol return_type = Methods[convert_type][this->name].second;
+  Formals formals = method->formals;
+  Symbol return_type = method->return_type;
 
   // 4) Check if number of parameters are matched
   if (formals->len() != this->actual->len()) {
@@ -171,7 +201,8 @@ void dispatch_class::type_check() {
   if (this->type != NULL) { return; }
 
   // 3) Check if method is not defined
-  if (Methods[T0_].find(this->name) == Methods[T0_].end()) {
+  auto method = lookup_method(T0_, this->name);
+  if (!method) {
     classtable->semant_error(Current_Class)
         << "Error: method \"" << this->name->get_string()
         << "\" of class \"" << T0_->get_string()
@@ -180,8 +211,8 @@ void dispatch_class::type_check() {
     return;
   }
 
-  Formals formals = Methods[T0_][this->name].first;
-  Symbol return_type = Methods[T0_][this->name].second;
+  Formals formals = method->formals;
+  Symbol return_type = method->return_type;
 
   // 4) Check if number of parameters are matched
   if (formals->len() != this->actual->len()) {
@@ -603,25 +634,14 @@ void class__class::type_check() {
   ObjectIDs.addid(self, SELF_TYPE);
 
   // 2. Collect class attributes (including any inherited) into Object environment
-  Symbol cur_node = this->name;
-  while (classtable->get_father(cur_node) != cur_node) {
-    auto cur_class = static_cast<class__class*>(classtable->GetNode(cur_node));
-    Features cur_features = cur_class->features;
-    for (auto i = cur_features->first(); cur_features->more(i); i = cur_features->next(i)) {
-      Feature cur_feature = cur_features->nth(i);
-      if (typeid(*cur_feature) == typeid(attr_class)) {
-        attr_class* cur_attr = static_cast<attr_class*>(cur_feature);
-        ObjectIDs.addid(cur_attr->name, cur_attr->type_decl);
-      }
-    }
-    // Look up to its father
-    cur_node = classtable->get_father(cur_node);
+  for (auto cur_attr: classtable->probe(this->name)->layout.attrs) {
+    ObjectIDs.addid(cur_attr->name, cur_attr->type_decl);
   }
 
   // 3. Start analyzing methods
   for (auto i = this->features->first(); this->features->more(i); i = this->features->next(i)) {
     Feature cur_feature = this->features->nth(i);
-    if (typeid(*cur_feature) == typeid(method_class)) {
+    if (cur_feature->get_kind() == method_kind) {
       ObjectIDs.enterscope();
 
       method_class* cur_method = static_cast<method_class*>(cur_feature);
@@ -658,7 +678,7 @@ void class__class::type_check() {
       }
 
       ObjectIDs.exitscope();
-    } else if (typeid(*cur_feature) == typeid(attr_class)) {
+    } else if (cur_feature->get_kind() == attr_kind) {
       // 4) Type check the attributes
       attr_class* cur_attr = static_cast<attr_class*>(cur_feature);
       cur_attr->init->type_check();
@@ -695,26 +715,29 @@ void class__class::type_check() {
      errors. Part 2) can be done in a second stage, when you want
      to build mycoolc.
  */
+// A program type checked already, loaded from an AST file (see
+// astfile.h), only needs its class table for cgen
+void program_class::install_classes() {
+  classtable = new ClassTable(classes);
+}
+
 void program_class::semant() {
   /* ClassTable constructor may do some semantic analysis */
   classtable = new ClassTable(classes);
 
+  PhaseTimer pass1("pass 1: features");
+
   // Record method names in each class
   std::set<Symbol> hash_methods;
   // Record attr names in each class
   std::set<Symbol> hash_attributes;
   // Record formal names in each method
   std::set<Symbol> hash_formals;
-  // Record all attribute names in each class, map class name to vector of attributes
-  std::map<Symbol, vector<Symbol>> get_attr;
 
   //
   // First pass: collect info of all methods and attributes
   //
-
-  // Record methods of each class, key is class name
-  map<Symbol, vector<pair<Symbol, pair<Formals, Symbol> > > > class_methods;
-
+  Methods.clear();
   for (auto cls: classtable->getClasses()) {
     hash_methods.clear();
     hash_attributes.clear();
@@ -724,7 +747,7 @@ void program_class::semant() {
          cur_features->more(j);
          j = cur_features->next(j)) {
       Feature cur_feature = cur_features->nth(j);
-      if (typeid(*cur_feature) == typeid(method_class)) {
+      if (cur_feature->get_kind() == method_kind) {
         method_class* cur_method = static_cast<method_class*>(cur_feature);
         Formals formals = cur_method->formals;
         hash_formals.clear();
@@ -754,11 +777,8 @@ void program_class::semant() {
           }
         }
         hash_methods.insert(cur_method->name);
-        class_methods[Current_Class->name].push_back(
-            make_pair(cur_method->name,
-                      make_pair(cur_method->formals,
-                                cur_method->return_type)));
-      } else if (typeid(*cur_feature) == typeid(attr_class)) {
+        Methods[Current_Class->name].own[cur_method->name] = cur_method;
+      } else if (cur_feature->get_kind() == attr_kind) {
         // Collect attributes of each class
         attr_class* cur_attr = static_cast<attr_class*>(cur_feature);
         if (cur_attr->name == self) {
@@ -772,7 +792,6 @@ void program_class::semant() {
           classtable->semant_error(Current_Class) << "Error: local class attribute \""
                                                   << cur_attr->name->get_string() << "\" is redefined." << endl;
         }
-        get_attr[Current_Class->name].push_back(cur_attr->name);
       } else {
         classtable->semant_error(Current_Class)
             << "Fatal error: unknown AST tree node. BUG in compiler!!!" << endl;
@@ -786,88 +805,77 @@ void program_class::semant() {
     exit(1);
   }
 
-  // Record all attributes in classes from a inheritance tree leave to root
-  std::set<Symbol> all_attr;
-  // Record all methods in classes from a inheritance tree leave to root
-  // This maps a method name to its formals and return type
-  std::map<Symbol, pair<Formals, Symbol> > all_methods;
-  // Get all leave nodes according to inheritance tree, these are class names
-  vector<Symbol>* all_leaves = classtable->get_leaves();
+  // Every class inherits the methods of its parent
+  for (auto cls: classtable->getClasses()) {
+    if (cls->name != Object) {
+      Methods[cls->name].parent = &Methods[classtable->get_father(cls->name)];
+    }
+  }
+
+  pass1.stop();
 
   //
   // Second pass:
   // 1. Check if all attributes are defined unique in inheritance graph
   // 2. Check if methods are properly overwritten
   //
+  PhaseTimer pass2("pass 2: inheritance");
 
-  for (auto i = 0; i < all_leaves->size(); i++) {
-    all_attr.clear();
-    Symbol leave = (*all_leaves)[i];
-    // Check first condition from leaves of the inheritance graph, and go up to the root
-    while (classtable->get_father(leave) != leave) {
-      for (auto j = 0; j < get_attr[leave].size(); j++) {
-        if (all_attr.find(get_attr[leave][j]) == all_attr.end()) {
-          all_attr.insert(get_attr[leave][j]);
-        } else {
-          classtable->semant_error(classtable->GetNode(leave))
-              << "Error: attribute \"" << get_attr[leave][j]->get_string()
-              << "\" in class \"" << static_cast<class__class*>(classtable->GetNode(leave))->name->get_string()
-              << "\" is overwritten." << endl;
-        }
+  for (auto cls: classtable->getClasses()) {
+    auto parent = cls->get_parentnd();
+    for (auto feature: *cls->features) {
+      if (feature->get_kind() != attr_kind) { continue; }
+      auto attr = static_cast<attr_class*>(feature);
+      if (parent->layout.attr_index.count(attr->name)) {
+        classtable->semant_error(cls)
+            << "Error: attribute \"" << attr->name->get_string()
+            << "\" in class \"" << cls->name->get_string()
+            << "\" is overwritten." << endl;
       }
-      leave = classtable->get_father(leave);
     }
+  }
 
-    // Check if formals are same when overwriting methods
-    all_methods.clear();
-    leave = (*all_leaves)[i];
-    while (true) {
-      for (auto j = 0; j < class_methods[leave].size(); j++) {
-        if (all_methods.find(class_methods[leave][j].first) == all_methods.end()) {
-          all_methods[class_methods[leave][j].first] = class_methods[leave][j].second;
-        } else {
-          Formals super_formals = class_methods[leave][j].second.first;
-          Formals sub_formals = all_methods[class_methods[leave][j].first].first;
-          Symbol super_return_type = class_methods[leave][j].second.second;
-          Symbol sub_return_type = all_methods[class_methods[leave][j].first].second;
-          if (super_return_type != sub_return_type) {
-            classtable->semant_error(classtable->GetNode(leave)) << "Error: method \""
-                                                                 << class_methods[leave][j].first->get_string()
-                                                                 << "\" in class \""
-                                                                 << static_cast<class__class*>(classtable->GetNode(
-                                                                     leave))->name->get_string()
-                                                                 << "\" is overwritten with different return type."
-                                                                 << endl;
-          }
-          if (super_formals->len() != sub_formals->len()) {
-            classtable->semant_error(classtable->GetNode(leave)) << "Error: method \""
-                                                                 << class_methods[leave][j].first->get_string()
-                                                                 << "\" in class \""
-                                                                 << static_cast<class__class*>(classtable->GetNode(
-                                                                     leave))->name->get_string()
-                                                                 << "\" is overwritten with different number of formals."
-                                                                 << endl;
-          }
-          for (auto m = super_formals->first(), n = sub_formals->first();
-               super_formals->more(m) && sub_formals->more(n);
-               m = super_formals->next(m), n = sub_formals->next(n)) {
-            auto super_formal = static_cast<formal_class*>(super_formals->nth(m));
-            auto sub_formal = static_cast<formal_class*>(sub_formals->nth(n));
-            if (super_formal->type_decl != sub_formal->type_decl) {
-              classtable->semant_error(classtable->GetNode(leave))
-                  << "Error: type of formal \"" << super_formal->name->get_string()
-                  << "\" in method \"" << class_methods[leave][j].first->get_string() << "\" of class \""
-                  << static_cast<class__class*>(classtable->GetNode(leave))->name->get_string()
-                  << "\" is changed when overwriting method in subclass." << endl;
-              break;
-            }
-          }
+  // Check if formals are same when overwriting methods: each method
+  // against the one it overrides, if any
+  for (auto cls: classtable->getClasses()) {
+    auto parent = Methods[cls->name].parent;
+    if (!parent) { continue; }
+    for (auto feature: *cls->features) {
+      if (feature->get_kind() != method_kind) { continue; }
+      auto sub_method = static_cast<method_class*>(feature);
+      method_class* super_method = parent->lookup(sub_method->name);
+      if (!super_method) { continue; }
+      Formals super_formals = super_method->formals;
+      Formals sub_formals = sub_method->formals;
+      if (super_method->return_type != sub_method->return_type) {
+        classtable->semant_error(cls) << "Error: method \""
+                                      << sub_method->name->get_string()
+                                      << "\" in class \"" << cls->name->get_string()
+                                      << "\" is overwritten with different return type."
+                                      << endl;
+      }
+      if (super_formals->len() != sub_formals->len()) {
+        classtable->semant_error(cls) << "Error: method \""
+                                      << sub_method->name->get_string()
+                                      << "\" in class \"" << cls->name->get_string()
+                                      << "\" is overwritten with different number of formals."
+                                      << endl;
+      }
+      for (auto m = super_formals->first(), n = sub_formals->first();
+           super_formals->more(m) && sub_formals->more(n);
+           m = super_formals->next(m), n = sub_formals->next(n)) {
+        auto super_formal = static_cast<formal_class*>(super_formals->nth(m));
+        auto sub_formal = static_cast<formal_class*>(sub_formals->nth(n));
+        if (super_formal->type_decl != sub_formal->type_decl) {
+          classtable->semant_error(cls)
+              << "Error: type of formal \"" << super_formal->name->get_string()
+              << "\" in method \"" << sub_method->name->get_string() << "\" of class \""
+              << cls->name->get_string()
+              << "\" is changed when overwriting method in subclass." << endl;
+          break;
         }
       }
-      if (leave == Object) { break; }
-      leave = classtable->get_father(leave);
     }
-
   }
 
   if (classtable->errors()) {
@@ -875,35 +883,23 @@ void program_class::semant() {
     exit(1);
   }
 
+  pass2.stop();
+
   //
   // Third pass:
-  // 1. Collect all methods of each class
-  // 2. Check if all types in class attributes and method formals are defined
+  // Check if all types in class attributes and method formals are defined
   //
+  PhaseTimer pass3("pass 3: declared types");
   Main = NULL;
   main_meth = NULL;
-  Methods.clear();
   for (auto cls: classtable->getClasses()) {
-    all_methods.clear();
     // Set global current class
     Current_Class = cls;
-    Symbol leave = Current_Class->name;
-    while (true) {
-      for (auto j = 0; j < class_methods[leave].size(); j++) {
-        if (all_methods.find(class_methods[leave][j].first) == all_methods.end()) {
-          all_methods[class_methods[leave][j].first] = class_methods[leave][j].second;
-        }
-      }
-      if (leave == Object) { break; }
-      leave = classtable->get_father(leave);
-    }
-    Methods[Current_Class->name] = all_methods;
-
     for (auto i = Current_Class->features->first();
          Current_Class->features->more(i);
          i = Current_Class->features->next(i)) {
       Feature cur_feature = Current_Class->features->nth(i);
-      if (typeid(*cur_feature) == typeid(method_class)) {
+      if (cur_feature->get_kind() == method_kind) {
         method_class* cur_method = static_cast<method_class*>(cur_feature);
         // 0) Check if Main class and main method are defined
         if (strcmp(cur_method->name->get_string(), "main") == 0
@@ -937,7 +933,7 @@ void program_class::semant() {
               << "Error: type \"" << T0->get_string()
               << "\" is used without being defined." << endl;
         }
-      } else if (typeid(*cur_feature) == typeid(attr_class)) {
+      } else if (cur_feature->get_kind() == attr_kind) {
         attr_class* cur_attr = static_cast<attr_class*>(cur_feature);
         if (cur_attr->type_decl != SELF_TYPE) {
           if (!classtable->HaveClass(cur_attr->type_decl)) {
@@ -963,13 +959,25 @@ void program_class::semant() {
     exit(1);
   }
 
+  pass3.stop();
+
   //
   // Forth pass: type checking for each class
+  // The classes are checked in parallel, each logging its errors apart;
+  // the logs are merged in source order, as if checked one by one.
   //
-  for (auto i = this->classes->first();
-       this->classes->more(i);
-       i = this->classes->next(i)) {
+  PhaseTimer pass4("pass 4: type check");
+  auto phase = PhaseTimer::current();
+  vector<ClassTable::ErrorLog> logs(this->classes->len());
+  parallel_for(this->classes->len(), [&](int i) {
+    PhaseWorker worker(phase);
+    PhaseTimer timer("class");
+    ClassTable::redirect_errors(&logs[i]);
     this->classes->nth(i)->type_check();
+    ClassTable::redirect_errors(NULL);
+  });
+  for (auto& log: logs) {
+    classtable->merge_errors(log);
   }
 
   if (classtable->errors()) {
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "classtable.h"
+#include "cool-io.h"
+#include "parallel.h"
+#include "server.h"
+
+extern int optind;
+void handle_flags(int argc, char* argv[]);
+
+namespace {
+
+struct Request {
+  int id;
+  std::string line;
+};
+
+// A request being compiled by a child
+struct Job {
+  int id;
+  pid_t pid;
+  int fds[2];               // its stdout and stderr, -1 once closed
+  std::string output[2];
+};
+
+// Compile request in the child, with its output going to out and err
+void run_child(const Request& request, int out, int err,
+               int (*compile)(int, char**)) {
+  int null = open("/dev/null", O_RDONLY);
+  dup2(null, 0);
+  dup2(out, 1);
+  dup2(err, 2);
+
+  // One thread, unless the request says otherwise with a later -j
+  std::vector<std::string> args = {"coolc", "-j", "1"};
+  std::istringstream in(request.line);
+  for (std::string arg; in >> arg;) { args.push_back(arg); }
+  std::vector<char*> argv;
+  for (auto& arg: args) { argv.push_back(&arg[0]); }
+  argv.push_back(NULL);
+
+  optind = 0;  // getopt starts over
+  handle_flags(args.size(), argv.data());
+  exit(compile(args.size(), argv.data()));
+}
+
+Job start(const Request& request, int (*compile)(int, char**)) {
+  int out[2], err[2];
+  if (pipe(out) != 0 || pipe(err) != 0) {
+    perror("coolc: pipe");
+    exit(1);
+  }
+  cout.flush();  // or the child would write it again
+  Job job;
+  job.id = request.id;
+  job.fds[0] = out[0];
+  job.fds[1] = err[0];
+  job.pid = fork();
+  if (job.pid < 0) {
+    perror("coolc: fork");
+    exit(1);
+  }
+  if (job.pid == 0) {
+    close(out[0]);
+    close(err[0]);
+    run_child(request, out[1], err[1], compile);
+  }
+  close(out[1]);
+  close(err[1]);
+  return job;
+}
+
+// Read what is there on fd into text; false at the end of the file
+bool read_some(int fd, std::string& text) {
+  char buf[1 << 16];
+  ssize_t n;
+  do {
+    n = read(fd, buf, sizeof(buf));
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) { return false; }
+  text.append(buf, n);
+  return true;
+}
+
+void respond(Job& job) {
+  int status;
+  while (waitpid(job.pid, &status, 0) < 0 && errno == EINTR) {}
+  int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  cout << job.id << " " << code << " " << job.output[0].size() << " "
+       << job.output[1].size() << "\n" << job.output[0] << job.output[1];
+  cout.flush();
+}
+
+}
+
+int serve(int (*compile)(int, char**)) {
+  // Set up what every compilation shares before forking the first
+  ClassTable::basic_classes();
+
+  int workers = worker_count(1 << 20);
+  std::deque<Request> waiting;
+  std::vector<Job> running;
+  std::string input;
+  bool input_open = true;
+  int next_id = 0;
+
+  while (input_open || !waiting.empty() || !running.empty()) {
+    while (!waiting.empty() && (int) running.size() < workers) {
+      running.push_back(start(waiting.front(), compile));
+      waiting.pop_front();
+    }
+
+    std::vector<pollfd> fds;
+    if (input_open) { fds.push_back({0, POLLIN, 0}); }
+    for (auto& job: running) {
+      for (int fd: job.fds) {
+        if (fd >= 0) { fds.push_back({fd, POLLIN, 0}); }
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) { continue; }
+      perror("coolc: poll");
+      return 1;
+    }
+
+    size_t k = 0;
+    if (input_open && fds[k++].revents) {
+      input_open = read_some(0, input);
+      if (!input_open && !input.empty() && input.back() != '\n') { input += '\n'; }
+      size_t begin = 0;
+      for (size_t end; (end = input.find('\n', begin)) != std::string::npos;
+           begin = end + 1) {
+        auto line = input.substr(begin, end - begin);
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+          waiting.push_back({next_id++, line});
+        }
+      }
+      input.erase(0, begin);
+    }
+    for (auto& job: running) {
+      for (int i = 0; i < 2; i++) {
+        if (job.fds[i] < 0) { continue; }
+        if (fds[k++].revents && !read_some(job.fds[i], job.output[i])) {
+          close(job.fds[i]);
+          job.fds[i] = -1;
+        }
+      }
+    }
+
+    for (size_t j = 0; j < running.size();) {
+      if (running[j].fds[0] < 0 && running[j].fds[1] < 0) {
+        respond(running[j]);
+        running.erase(running.begin() + j);
+      } else {
+        j++;
+      }
+    }
+  }
+  return 0;
+}
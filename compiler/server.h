@@ -0,0 +1,27 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+//
+// Compiler server.  coolc -i reads compile requests from stdin, one per
+// line, and compiles each in a child forked from the server, which has
+// the predefined symbols and the basic classes set up already: a request
+// costs neither an exec nor the setup of the compiler.  Up to -j requests
+// are compiled at once (one per hardware thread by default), each on one
+// thread unless it asks for more.
+//
+// A request is the arguments of a coolc command line, separated by
+// blanks.  Requests are numbered from 0 in the order they are read, and
+// for each one a response is written to stdout once it is compiled, in
+// the order they finish:
+//
+//   <request number> <exit status> <stdout size> <stderr size>\n
+//   <stdout of the compilation><stderr of the compilation>
+//
+// The server exits when stdin is closed and every request is answered.
+//
+
+// Serve the requests on stdin, compiling each with compile once its
+// flags are handled.  Returns the exit status of the server.
+int serve(int (*compile)(int argc, char* argv[]));
+
+#endif
@@ -1,8 +1,13 @@
 #include <assert.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
 #include "emit.h"
 #include "cgen.h"
 #include "globals.h"
 
+using std::vector;
+
 extern char* pad(int n);
 
 //
@@ -19,7 +24,7 @@ template
 class StringTable<IntEntry>;
 
 Entry::Entry(const char* s, int l, int i)
-    : str(s), len(l), index(i) {}
+    : str(s, l), len(l), index(i), first_use(-1) {}
 
 ostream& Entry::print(ostream& s) const {
   return s << "{" << str << ", " << len << ", " << index << "}\n";
@@ -65,6 +70,8 @@ IdEntry::IdEntry(const char* s, int l, int i) : Entry(s, l, i) {}
 
 IntEntry::IntEntry(const char* s, int l, int i) : Entry(s, l, i) {}
 
+thread_local long long string_use = -1;
+
 IdTable idtable;
 IntTable inttable;
 StrTable stringtable;
@@ -99,7 +106,39 @@ BoolConst truebool(TRUE);
 // Strings
 //
 void StringEntry::code_ref(ostream& s) {
-  s << STRCONST_PREFIX << index;
+  assert(!label.empty());
+  s << label;
+}
+
+//
+// StrTable::label_constants
+// A string constant is named after a hash of its contents rather than its
+// index, so that its label stays the same when other constants come and
+// go, and the cached code of classes that load it can be reused (see
+// codecache.h).  Constants whose hashes collide are told apart by index.
+//
+void StrTable::label_constants() {
+  auto content_hash = [](const StringEntry& e) {
+    unsigned long long h = 14695981039346656037ULL;   // FNV-1a
+    for (int i = 0; i < e.get_len(); i++) {
+      h = (h ^ (unsigned char) e.get_string()[i]) * 1099511628211ULL;
+    }
+    return h;
+  };
+  std::unordered_map<unsigned long long, int> count;
+  for (auto& p: tbl) {
+    count[content_hash(*p)]++;
+  }
+  for (auto& p: tbl) {
+    auto h = content_hash(*p);
+    char name[64];
+    if (count[h] == 1) {
+      snprintf(name, sizeof(name), "%s_%016llx", STRCONST_PREFIX, h);
+    } else {
+      snprintf(name, sizeof(name), "%s_%016llx_%d", STRCONST_PREFIX, h, p->get_index());
+    }
+    p->label = name;
+  }
 }
 
 //
@@ -108,7 +147,7 @@ void StringEntry::code_ref(ostream& s) {
 //
 
 void StringEntry::code_def(ostream& s, int stringclasstag) {
-  IntEntryP lensym = inttable.add_int(len);
+  IntEntryP lensym = inttable.add_int(len);   // added by code_string_table
 
   // Add -1 eye catcher
   s << WORD << "-1" << endl;
@@ -129,19 +168,77 @@ void StringEntry::code_def(ostream& s, int stringclasstag) {
 //
 // StrTable::code_string
 // Generate a string object definition for every string constant in the
-// stringtable.
+// stringtable, those in hot first.  The Int constants for their lengths
+// are added to the inttable beforehand, so it is complete when its turn
+// comes.
 //
-void StrTable::code_string_table(ostream& s, int stringclasstag) {
-  for (auto p: tbl) {
+void StrTable::code_string_table(ostream& s, int stringclasstag,
+                                 const vector<StringEntry*>& hot) {
+  for (auto& p: tbl) {
+    inttable.add_int(p->get_len());
+  }
+  for (auto p: emission_order(hot)) {
     p->code_def(s, stringclasstag);
   }
 }
 
+//
+// Must agree with the hash computed by _str_intern in the runtime:
+// h = h * 31 + c over the bytes of the string, modulo 2^32.
+//
+static unsigned int intern_hash(const char* str, int len) {
+  unsigned int h = 0;
+  for (int i = 0; i < len; i++) {
+    h = h * 31 + (unsigned char) str[i];
+  }
+  return h;
+}
+
+//
+// StrTable::code_intern_table
+// Emit an open addressing hash table of pointers to the string constants,
+// preceded by the bucket mask.  The runtime looks up strings built by
+// in_string and concat in it and returns the constant instead, so equal
+// strings compare by pointer.  Without -O the table is empty (mask 0).
+//
+void StrTable::code_intern_table(ostream& s) {
+  s << GLOBAL << STRINTERNTAB << endl
+    << STRINTERNTAB << LABEL;
+  if (!cgen_optimize) {
+    s << WORD << 0 << endl;
+    return;
+  }
+  size_t size = 2;
+  while (size < 2 * tbl.size()) { size *= 2; }
+  vector<StringEntry*> slots(size, nullptr);
+  for (auto& p: tbl) {
+    auto i = intern_hash(p->get_string(), p->get_len()) & (size - 1);
+    while (slots[i]) { i = (i + 1) & (size - 1); }
+    slots[i] = p.get();
+  }
+  s << WORD << size - 1 << endl;
+  for (auto p: slots) {
+    s << WORD;
+    if (p) { p->code_ref(s); } else { s << 0; }
+    s << endl;
+  }
+}
+
+void StrTable::code_globals(ostream& s) {
+  for (auto& p: tbl) {
+    s << GLOBAL;
+    p->code_ref(s);
+    s << endl;
+  }
+}
+
 //
 // Ints
 //
+// Named after the digits, which stay the same whatever other constants
+// there are
 void IntEntry::code_ref(ostream& s) {
-  s << INTCONST_PREFIX << index;
+  s << INTCONST_PREFIX << str;
 }
 
 //
@@ -165,14 +262,53 @@ void IntEntry::code_def(ostream& s, int intclasstag) {
 //
 // IntTable::code_string_table
 // Generate an Int object definition for every Int constant in the
-// inttable.
+// inttable, those in hot first.
 //
-void IntTable::code_string_table(ostream& s, int intclasstag) {
-  for (auto p: tbl) {
+void IntTable::code_string_table(ostream& s, int intclasstag,
+                                 const vector<IntEntry*>& hot) {
+  for (auto p: emission_order(hot)) {
     p->code_def(s, intclasstag);
   }
 }
 
+//
+// IntTable::code_int_cache
+// Emit one Int object for every value in [INT_CACHE_MIN, INT_CACHE_MAX],
+// INT_CACHE_STRIDE bytes apart, preceded by the range.  Arithmetic and
+// the runtime return these instead of allocating.
+//
+void IntTable::code_int_cache(ostream& s, int intclasstag) {
+  int size = INT_CACHE_MAX >= INT_CACHE_MIN ? INT_CACHE_MAX - INT_CACHE_MIN + 1 : 0;
+  s << GLOBAL << INTCACHEMIN << endl
+    << INTCACHEMIN << LABEL
+    << WORD << INT_CACHE_MIN << endl
+    << GLOBAL << INTCACHESIZE << endl
+    << INTCACHESIZE << LABEL
+    << WORD << size << endl
+    << GLOBAL << INTCACHE << endl;
+  if (size == 0) {
+    s << INTCACHE << LABEL;
+    return;
+  }
+  for (int i = INT_CACHE_MIN; i <= INT_CACHE_MAX; i++) {
+    s << WORD << "-1" << endl;
+    if (i == INT_CACHE_MIN) { s << INTCACHE << LABEL; }
+    s << WORD << intclasstag << endl
+      << WORD << (DEFAULT_OBJFIELDS + INT_SLOTS) << endl
+      << WORD << Int->get_string() << DISPTAB_SUFFIX << endl
+      << WORD << i << endl;
+  }
+}
+
+
+void IntTable::code_globals(ostream& s) {
+  for (auto& p: tbl) {
+    s << GLOBAL;
+    p->code_ref(s);
+    s << endl;
+  }
+}
+
 
 //
 // Bools
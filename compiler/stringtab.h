@@ -4,8 +4,9 @@
 #include <assert.h>
 #include <string.h>
 #include <string>
-#include <set>
+#include <vector>
 #include <memory>
+#include <mutex>
 #include <algorithm>
 #include "cool-io.h"
 
@@ -13,9 +14,9 @@
 
 using std::min;
 using std::string;
-using std::function;
 using std::shared_ptr;
 using std::make_shared;
+using std::unique_ptr;
 
 class Entry;
 
@@ -36,11 +37,13 @@ class Entry {
   string str;     // the string it self
   int len;       // the length of the string (without trailing \0)
   int index;     // a unique index for each string
+  long long first_use;  // see string_use
+  template<class Elem> friend class StringTable;
  public:
   Entry(const char* s, int l, int i);
 
-  bool operator<(Entry& other) {
-    return str < other.str;
+  bool equals(const char* s, int l) const {
+    return len == l && memcmp(str.data(), s, l) == 0;
   }
 
   ostream& print(ostream& s) const;
@@ -68,6 +71,8 @@ class Entry {
 // references (respectively) to constants.  
 //
 class StringEntry : public Entry {
+  friend class StrTable;
+  string label;  // set by StrTable::label_constants
  public:
   void code_def(ostream& str, int stringclasstag);
 
@@ -100,18 +105,41 @@ typedef IntEntry* IntEntryP;
 //
 //////////////////////////////////////////////////////////////////////////
 
+// The tables are shared by the threads that parse the input files, and
+// the indexes they give depend on which thread gets to a string first.
+// Each thread numbers the strings it adds in string_use: the file it
+// parses in the high bits, the count of strings so far in the low ones.
+// sort_by_first_use() then gives every table the order parsing the
+// files one by one would.  -1 when not parsing.
+extern thread_local long long string_use;
+
 template<class Elem>
 class StringTable {
  protected:
-  using ElemP = shared_ptr<Elem>;
-  // a string table is a STL set
-  std::set<ElemP, function<bool(ElemP, ElemP)>> tbl;
+  struct Bucket {
+    unsigned hash;
+    Elem* elem;
+  };
+  // the entries in index order: index i is tbl[i - 1]
+  std::vector<unique_ptr<Elem>> tbl;
+  // open addressing hash table of the entries, a power of two in size
+  std::vector<Bucket> buckets;
   // the current index
   int index;
+  // add_string may be called from several threads at once
+  std::mutex lock;
+
+  static unsigned hash(const char* s, int len);
+
+  // the bucket holding s, or the empty one where it belongs
+  Bucket& find(const char* s, int len, unsigned h);
+
+  void grow();
+
+  // the entries in hot, then all the others in index order
+  std::vector<Elem*> emission_order(const std::vector<Elem*>& hot);
  public:
-  StringTable() : tbl([](ElemP a, ElemP b) {
-    return *a < *b;
-  }), index(0) {}
+  StringTable() : buckets(64, Bucket{0, nullptr}), index(0) {}
 
   // The following methods each add a string to the string table.
   // Only one copy of each string is maintained.
@@ -126,6 +154,9 @@ class StringTable {
   // add the string representation of an integer
   Elem* add_int(int i);
 
+  // number the entries by their first use (see string_use)
+  void sort_by_first_use();
+
   // lookup an element using its index
   Elem* lookup(int index);
 
@@ -138,17 +169,32 @@ class IdTable : public StringTable<IdEntry> {
 
 class StrTable : public StringTable<StringEntry> {
  public:
-  void code_string_table(ostream&, int classtag);
+  // name every constant, before any code refers to one
+  void label_constants();
+
+  // emit the constants in hot first, next to each other
+  void code_string_table(ostream&, int classtag, const std::vector<StringEntry*>& hot);
+
+  // hash table of all string constants for the runtime _str_intern
+  void code_intern_table(ostream&);
+
+  // declare every constant global, for the units of coolc -u
+  void code_globals(ostream&);
 };
 
 class IntTable : public StringTable<IntEntry> {
  public:
-  void code_string_table(ostream&, int classtag);
+  void code_string_table(ostream&, int classtag, const std::vector<IntEntry*>& hot);
+  void code_int_cache(ostream&, int classtag);
+
+  // declare every constant global, for the units of coolc -u
+  void code_globals(ostream&);
 };
 
 //
-// A string table is implemented a linked list of Entrys.  Each Entry
-// in the list has a unique string.
+// A string table is a vector of Entrys in the order they were added,
+// and a hash table to find them by string.  Each Entry has a unique
+// string.
 //
 
 template<class Elem>
@@ -156,39 +202,96 @@ Elem* StringTable<Elem>::add_string(const char* s) {
   return add_string(s, MAXSIZE);
 }
 
+// FNV-1a
+template<class Elem>
+unsigned StringTable<Elem>::hash(const char* s, int len) {
+  unsigned h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h = (h ^ (unsigned char) s[i]) * 16777619u;
+  }
+  return h;
+}
+
+template<class Elem>
+typename StringTable<Elem>::Bucket& StringTable<Elem>::find(
+    const char* s, int len, unsigned h) {
+  size_t mask = buckets.size() - 1;
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    Bucket& b = buckets[i];
+    if (!b.elem || (b.hash == h && b.elem->equals(s, len))) { return b; }
+  }
+}
+
+// Double the hash table when it gets half full
+template<class Elem>
+void StringTable<Elem>::grow() {
+  std::vector<Bucket> old(buckets.size() * 2, Bucket{0, nullptr});
+  old.swap(buckets);
+  size_t mask = buckets.size() - 1;
+  for (auto& b : old) {
+    if (!b.elem) { continue; }
+    size_t i = b.hash & mask;
+    while (buckets[i].elem) { i = (i + 1) & mask; }
+    buckets[i] = b;
+  }
+}
+
 //
-// Add a string requires two steps.  First, the set is searched; if the
-// string is found, a pointer to the existing Entry for that string is
-// returned.  If the string is not found, a new Entry is created and added
-// to the list.
+// Add a string requires two steps.  First, the hash table is searched;
+// if the string is found, a pointer to the existing Entry for that string
+// is returned.  If the string is not found, a new Entry is created and
+// added to the table.
 //
 template<class Elem>
 Elem* StringTable<Elem>::add_string(
     const char* s, int maxchars) {
-  int len = min((int)strlen(s), maxchars);
-  auto key = make_shared<Elem>(s, len, index + 1);
-  auto iter = tbl.find(key);
-  if (iter == tbl.end()) {
-    index++;
-    tbl.insert(key);
-    return key.get();
-  } else {
-    return iter->get();
+  int len = strnlen(s, maxchars);
+  unsigned h = hash(s, len);
+  long long use = string_use < 0 ? -1 : string_use++;
+  std::lock_guard<std::mutex> guard(lock);
+  Bucket* b = &find(s, len, h);
+  if (b->elem) {
+    if (use < b->elem->first_use) { b->elem->first_use = use; }
+    return b->elem;
+  }
+  if (2 * (tbl.size() + 1) > buckets.size()) {
+    grow();
+    b = &find(s, len, h);
   }
+  index++;
+  tbl.emplace_back(new Elem(s, len, index));
+  tbl.back()->first_use = use;
+  *b = Bucket{h, tbl.back().get()};
+  return b->elem;
 }
 
 //
-// To look up a string, the set is scanned until a matching Entry is located.
-// If no such entry is found, an assertion failure occurs.  Thus, this function
-// is used only for strings that one expects to find in the table.
+// Entries added outside of parsing keep their place in front.  The
+// uses are reset for the next files to be parsed.
+//
+template<class Elem>
+void StringTable<Elem>::sort_by_first_use() {
+  std::stable_sort(tbl.begin(), tbl.end(),
+                   [](const unique_ptr<Elem>& a, const unique_ptr<Elem>& b) {
+                     return a->first_use < b->first_use;
+                   });
+  for (size_t i = 0; i < tbl.size(); i++) {
+    tbl[i]->index = i + 1;
+    tbl[i]->first_use = -1;
+  }
+}
+
+//
+// To look up a string, the hash table is searched for a matching Entry.
+// If no such entry is found, an assertion failure occurs.  Thus, this
+// function is used only for strings that one expects to find in the table.
 //
 template<class Elem>
 Elem* StringTable<Elem>::lookup_string(const char* s) {
-  auto key = make_shared<Elem>(s, strlen(s), index);
-  auto iter = tbl.find(key);
-  if (iter != tbl.end()) { return iter->get(); }
-  assert(false);   // fail if string is not found
-  return nullptr; // to avoid compiler warning
+  int len = strlen(s);
+  Elem* e = find(s, len, hash(s, len)).elem;
+  assert(e);   // fail if string is not found
+  return e;
 }
 
 //
@@ -197,13 +300,29 @@ Elem* StringTable<Elem>::lookup_string(const char* s) {
 //
 template<class Elem>
 Elem* StringTable<Elem>::lookup(int ind) {
-  for (auto ptr: tbl) {
-    if (ptr->get_index() == ind) {
-      return ptr.get();
+  assert(ind >= 1 && ind <= (int) tbl.size());  // fail if string is not found
+  return tbl[ind - 1].get();
+}
+
+//
+// The order constants are emitted in does not depend on anything but the
+// order they were added in.
+//
+template<class Elem>
+std::vector<Elem*> StringTable<Elem>::emission_order(const std::vector<Elem*>& hot) {
+  std::vector<Elem*> order;
+  order.reserve(tbl.size());
+  std::vector<bool> taken(tbl.size() + 1, false);
+  for (auto e : hot) {
+    if (!taken[e->get_index()]) {
+      taken[e->get_index()] = true;
+      order.push_back(e);
     }
   }
-  assert(false);  // fail if string is not found
-  return nullptr; // to avoid compiler warning
+  for (auto& p : tbl) {
+    if (!taken[p->get_index()]) { order.push_back(p.get()); }
+  }
+  return order;
 }
 
 //
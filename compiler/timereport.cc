@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "timereport.h"
+
+struct PhaseRecord {
+  const char* name;
+  int calls;
+  double wall;
+  double cpu;
+  long allocations;
+  long peak_rss;  // in kilobytes
+  std::vector<PhaseRecord*> children;  // in the order they were first timed
+};
+
+namespace {
+
+std::mutex records_lock;
+PhaseRecord top = {"", 0, 0, 0, 0, 0, {}};
+
+thread_local PhaseRecord* current_phase = &top;
+thread_local PhaseTimer* innermost_timer = NULL;
+thread_local bool on_worker = false;
+
+std::atomic<long> allocations(0);
+thread_local long thread_allocations = 0;
+
+double cpu_seconds() {
+  timespec t;
+  clock_gettime(on_worker ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+long allocations_so_far() {
+  return on_worker ? thread_allocations : allocations.load(std::memory_order_relaxed);
+}
+
+long peak_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+PhaseRecord* phase_in(PhaseRecord* parent, const char* name) {
+  std::lock_guard<std::mutex> guard(records_lock);
+  for (auto phase: parent->children) {
+    if (strcmp(phase->name, name) == 0) { return phase; }
+  }
+  parent->children.push_back(new PhaseRecord{name, 0, 0, 0, 0, 0, {}});
+  return parent->children.back();
+}
+
+void write_text(ostream& out, PhaseRecord* phase, int depth) {
+  out << std::left << std::setw(36) << std::string(2 * depth, ' ') + phase->name
+      << std::right << std::setw(7) << phase->calls
+      << std::fixed << std::setprecision(4)
+      << std::setw(11) << phase->wall << std::setw(11) << phase->cpu
+      << std::setw(13) << phase->allocations << std::setw(15) << phase->peak_rss
+      << "\n";
+  for (auto child: phase->children) { write_text(out, child, depth + 1); }
+}
+
+void write_json(ostream& out, PhaseRecord* phase, int depth) {
+  std::string indent(2 * depth, ' ');
+  out << indent << "{\"name\": \"" << phase->name << "\", \"calls\": " << phase->calls
+      << std::fixed << std::setprecision(6)
+      << ", \"wall_seconds\": " << phase->wall << ", \"cpu_seconds\": " << phase->cpu
+      << ", \"allocations\": " << phase->allocations
+      << ", \"peak_rss_kb\": " << phase->peak_rss << ", \"phases\": [";
+  for (size_t i = 0; i < phase->children.size(); i++) {
+    out << (i ? ",\n" : "\n");
+    write_json(out, phase->children[i], depth + 1);
+  }
+  if (!phase->children.empty()) { out << "\n" << indent; }
+  out << "]}";
+}
+
+}
+
+//
+// Allocations are counted by replacing operator new, only while timing
+//
+void* operator new(size_t size) {
+  if (time_report) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    thread_allocations++;
+  }
+  if (void* p = malloc(size ? size : 1)) { return p; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void count_allocation() {
+  if (time_report) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    thread_allocations++;
+  }
+}
+
+PhaseTimer::PhaseTimer(const char* name) : record_(NULL) {
+  if (!time_report) { return; }
+  parent_ = current_phase;
+  record_ = current_phase = phase_in(parent_, name);
+  outer_ = innermost_timer;
+  innermost_timer = this;
+  start_ = std::chrono::steady_clock::now();
+  cpu_start_ = cpu_seconds();
+  allocations_start_ = allocations_so_far();
+}
+
+void PhaseTimer::stop() {
+  if (!record_) { return; }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  double cpu = cpu_seconds() - cpu_start_;
+  long allocated = allocations_so_far() - allocations_start_;
+  long rss = peak_rss();
+  {
+    std::lock_guard<std::mutex> guard(records_lock);
+    record_->calls++;
+    record_->wall += wall;
+    record_->cpu += cpu;
+    record_->allocations += allocated;
+    if (rss > record_->peak_rss) { record_->peak_rss = rss; }
+  }
+  current_phase = parent_;
+  innermost_timer = outer_;
+  record_ = NULL;
+}
+
+PhaseRecord* PhaseTimer::current() {
+  return current_phase;
+}
+
+PhaseWorker::PhaseWorker(PhaseRecord* phase)
+    : saved_phase_(current_phase), saved_worker_(on_worker) {
+  current_phase = phase;
+  on_worker = true;
+}
+
+PhaseWorker::~PhaseWorker() {
+  current_phase = saved_phase_;
+  on_worker = saved_worker_;
+}
+
+void write_time_report(ostream& out) {
+  if (time_report == TIME_REPORT_JSON) {
+    out << "{\"phases\": [";
+    for (size_t i = 0; i < top.children.size(); i++) {
+      out << (i ? ",\n" : "\n");
+      write_json(out, top.children[i], 1);
+    }
+    out << "\n]}\n";
+    return;
+  }
+  out << "Time report (phases on worker threads count their thread alone)\n"
+      << std::left << std::setw(36) << "phase" << std::right << std::setw(7) << "calls"
+      << std::setw(11) << "wall (s)" << std::setw(11) << "cpu (s)"
+      << std::setw(13) << "allocations" << std::setw(15) << "peak RSS (KB)" << "\n";
+  for (auto phase: top.children) { write_text(out, phase, 0); }
+}
+
+void write_time_report_at_exit() {
+  static bool registered = false;
+  if (registered) { return; }
+  registered = true;
+  atexit([] {
+    // The phases an error exits from
+    while (innermost_timer) { innermost_timer->stop(); }
+    write_time_report(cerr);
+  });
+}
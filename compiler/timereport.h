@@ -0,0 +1,71 @@
+#ifndef TIMEREPORT_H
+#define TIMEREPORT_H
+
+//
+// Per-phase timing for -ftime-report.  A PhaseTimer times the scope it
+// is declared in as a phase of the compilation, nested in the phase
+// being timed around it: its wall time, CPU time, the allocations made
+// (through operator new, and the tree nodes taken from the node arena)
+// and the peak RSS when it ends.  Phases timed more than once, such as
+// one per class, add up.
+//
+// The report is written when coolc exits, also after an error: the
+// phases still being timed then end at the exit.
+//
+// Work for a phase done on other threads (see parallel.h) is timed by
+// thread: a PhaseWorker puts the thread in the phase, and the phases
+// timed on it then count the CPU time and allocations of the thread
+// alone.  Phases timed on the main thread count those of all threads.
+//
+
+#include <chrono>
+#include "cool-io.h"
+
+enum TimeReport { TIME_REPORT_NONE, TIME_REPORT_TEXT, TIME_REPORT_JSON };
+
+extern TimeReport time_report;  // -ftime-report[=json]
+
+struct PhaseRecord;
+
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(const char* name);
+
+  ~PhaseTimer() { stop(); }
+
+  // End the phase before the end of the scope
+  void stop();
+
+  // The phase being timed on this thread
+  static PhaseRecord* current();
+
+ private:
+  PhaseRecord* record_;  // NULL when not timing
+  PhaseRecord* parent_;
+  PhaseTimer* outer_;    // the timer of parent_ on this thread
+  std::chrono::steady_clock::time_point start_;
+  double cpu_start_;
+  long allocations_start_;
+};
+
+class PhaseWorker {
+ public:
+  explicit PhaseWorker(PhaseRecord* phase);
+
+  ~PhaseWorker();
+
+ private:
+  PhaseRecord* saved_phase_;
+  bool saved_worker_;
+};
+
+// Count an allocation not made through operator new
+void count_allocation();
+
+// Write the phases timed so far, as text or JSON after time_report
+void write_time_report(ostream& out);
+
+// Write the report to stderr when coolc exits
+void write_time_report_at_exit();
+
+#endif
@@ -6,10 +6,16 @@
 //
 ///////////////////////////////////////////////////////////////////////////
 
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+#include "timereport.h"
 #include "tree.h"
 
+using std::vector;
+
 /* line number to assign to the current node being constructed */
-int node_lineno = 1;
+thread_local int node_lineno = 1;
 
 ///////////////////////////////////////////////////////////////////////////
 //
@@ -23,6 +29,22 @@ tree_node::tree_node()
     line_number = node_lineno;
 }
 
+///////////////////////////////////////////////////////////////////////////
+//
+// node_kind_name
+//
+///////////////////////////////////////////////////////////////////////////
+const char *node_kind_name(NodeKind kind)
+{
+    static const char *names[] = {
+        "list",
+#define NODE_KIND(name) #name,
+        COOL_NODE_KINDS(NODE_KIND)
+#undef NODE_KIND
+    };
+    return names[kind];
+}
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // tree_node::get_line_number
@@ -40,3 +62,51 @@ tree_node *tree_node::set(tree_node *t) {
    line_number = t->line_number;
    return this;
 }
+
+///////////////////////////////////////////////////////////////////////////
+//
+// tree_arena_alloc, tree_node::operator new
+//
+// bump allocation from the node arena
+//
+///////////////////////////////////////////////////////////////////////////
+namespace {
+
+const size_t ARENA_BLOCK_SIZE = 256 * 1024;
+const size_t NODE_ALIGN = alignof(max_align_t);
+
+// Each thread allocates from a block of its own, so that files can be
+// parsed in parallel; only taking a new block is locked
+std::mutex arena_lock;
+vector<char*> arena_blocks;
+thread_local char* arena_next = NULL;
+thread_local char* arena_end = NULL;
+
+}
+
+void *tree_arena_alloc(size_t size) {
+  count_allocation();
+  size = (size + NODE_ALIGN - 1) & ~(NODE_ALIGN - 1);
+  if ((size_t) (arena_end - arena_next) < size) {
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    arena_next = static_cast<char*>(::operator new(block_size));
+    arena_end = arena_next + block_size;
+    std::lock_guard<std::mutex> guard(arena_lock);
+    arena_blocks.push_back(arena_next);
+  }
+  void *p = arena_next;
+  arena_next += size;
+  return p;
+}
+
+void *tree_node::operator new(size_t size) {
+  return tree_arena_alloc(size);
+}
+
+void free_tree_nodes() {
+  for (auto block : arena_blocks) {
+    ::operator delete(block);
+  }
+  arena_blocks.clear();
+  arena_next = arena_end = NULL;
+}
@@ -41,11 +41,37 @@
 //           sets the line number and type of "this" to the values in
 //           the argument tree_node.  Returns "this".
 //
+//       NodeKind get_kind();    return the constructor of the node
+//
+//   Nodes are allocated with a bump pointer from a shared arena, so a
+//   tree built by the parser lies in a few large blocks in the order it
+//   was built, each class and method body contiguous.  Every thread has
+//   blocks of its own.  They are never
+//   deleted one at a time: free_tree_nodes() releases them all at once,
+//   without running destructors.
 //
 ////////////////////////////////////////////////////////////////////////////
+// The constructors of cool-tree.h
+#define COOL_NODE_KINDS(X)                                             \
+  X(program) X(class_) X(method) X(attr) X(formal) X(branch) X(assign) \
+  X(static_dispatch) X(dispatch) X(cond) X(loop) X(typcase) X(block)  \
+  X(let) X(plus) X(sub) X(mul) X(divide) X(neg) X(lt) X(eq) X(leq)    \
+  X(comp) X(int_const) X(bool_const) X(string_const) X(new_)          \
+  X(isvoid) X(no_expr) X(object)
+
+enum NodeKind : unsigned char {
+  list_kind,
+#define NODE_KIND(name) name##_kind,
+  COOL_NODE_KINDS(NODE_KIND)
+#undef NODE_KIND
+};
+
+const char* node_kind_name(NodeKind kind);
+
 class tree_node {
  protected:
   int line_number;            // stash the line number when node is made
+  NodeKind kind;              // set by the constructor of each node class
  public:
   tree_node();
 
@@ -53,17 +79,31 @@ class tree_node {
 
   virtual ~tree_node() {}
 
+  static void* operator new(size_t size);
+
+  static void operator delete(void*) {}
+
   virtual void dump(ostream& stream, int n) = 0;
 
   int get_line_number();
 
+  NodeKind get_kind() { return kind; }
+
   tree_node* set(tree_node*);
 };
 
+// Release every tree node at once; no node may be used afterwards
+void free_tree_nodes();
+
+
+// Allocate size bytes from the node arena, released by free_tree_nodes()
+void* tree_arena_alloc(size_t size);
+
 ///////////////////////////////////////////////////////////////////
 //
 //  Lists of APS objects are implemented by the "list_node"
-//  template.  List elements have type Elem.  The interface is:
+//  template.  List elements have type Elem and are kept in one array
+//  in the node arena.  The interface is:
 //
 //     tree_node *copy()
 //     list_node<Elem> *copy_list()
@@ -88,14 +128,14 @@ class tree_node {
 //     for(int i = l->first(); l->more(i); i = l->next(i))
 //         ... operate on l->nth(i) ...
 //
-//      
+//     Elem* begin();
+//     Elem* end();
+//       The elements as an array, for "for (auto e : *l)".
+//
 //     int len()
 //     returns the length of the list
 //
-//     nth_length(int n, int &len);
-//     Returns the nth element of the list or NULL if there are not n elements.
-//     "len" is set to the length of the list.  This method is used internally
-//     by the APS package to efficiently traverse the list representation.  
+//     All of these take constant time.
 //
 //     static list_node<Elem> *nil();
 //     static list_node<Elem> *single(Elem);
@@ -103,7 +143,10 @@ class tree_node {
 //
 //     These three functions construct an empty list, a list of one element,
 //     and append two lists, respectively.  Note that the functions are static;
-//     there is no "this" parameter.  Example uses:
+//     there is no "this" parameter.  append adds the elements of the second
+//     list to the first one in place (in amortized constant time per
+//     element) and returns it, so the first list must not be used on its
+//     own afterwards.  Example uses:
 //
 //     list_node<Elem>::nil();
 //     list_node<Elem>::single(e);     where "e" has type Elem
@@ -111,11 +154,25 @@ class tree_node {
 //
 //////////////////////////////////////////////////////////////////////////////
 
+char* pad(int n);
+
+extern int info_size;
+
 template<class Elem>
 class list_node : public tree_node {
+  Elem* elems;
+  int length;
+  int capacity;
+
+  void push_back(Elem e);
+
  public:
+  list_node() : elems(NULL), length(0), capacity(0) { kind = list_kind; }
+
   tree_node* copy() { return copy_list(); }
 
+  list_node<Elem>* copy_list();
+
   Elem nth(int n);
 
   //
@@ -125,15 +182,15 @@ class list_node : public tree_node {
 
   int next(int n) { return n + 1; }
 
-  int more(int n) { return (n < len()); }
+  int more(int n) { return n < length; }
 
-  virtual list_node<Elem>* copy_list() = 0;
+  Elem* begin() { return elems; }
 
-  virtual ~list_node() {}
+  Elem* end() { return elems + length; }
 
-  virtual int len() = 0;
+  int len() { return length; }
 
-  virtual Elem nth_length(int n, int& len) = 0;
+  void dump(ostream& stream, int n);
 
   static list_node<Elem>* nil();
 
@@ -142,325 +199,104 @@ class list_node : public tree_node {
   static list_node<Elem>* append(list_node<Elem>* l1, list_node<Elem>* l2);
 };
 
-char* pad(int n);
-
-extern int info_size;
-
-template<class Elem>
-class nil_node : public list_node<Elem> {
- public:
-  list_node<Elem>* copy_list();
-
-  int len();
-
-  Elem nth_length(int n, int& len);
-
-  void dump(ostream& stream, int n);
-};
 
 template<class Elem>
-class single_list_node : public list_node<Elem> {
-  Elem elem;
- public:
-  single_list_node(Elem t) {
-    elem = t;
-  }
-
-  list_node<Elem>* copy_list();
-
-  int len();
-
-  Elem nth_length(int n, int& len);
-
-  void dump(ostream& stream, int n);
-};
-
+list_node<Elem>* list_node<Elem>::nil() { return new list_node<Elem>(); }
 
 template<class Elem>
-class append_node : public list_node<Elem> {
- private:
-  list_node<Elem>* some, * rest;
- public:
-  append_node(list_node<Elem>* l1, list_node<Elem>* l2) {
-    some = l1;
-    rest = l2;
-  }
-
-  list_node<Elem>* copy_list();
-
-  int len();
-
-  Elem nth(int n);
-
-  Elem nth_length(int n, int& len);
-
-  void dump(ostream& stream, int n);
-};
-
-
-template<class Elem>
-single_list_node<Elem>* list(Elem x);
-
-template<class Elem>
-append_node<Elem>* cons(Elem x, list_node<Elem>* l);
-
-template<class Elem>
-append_node<Elem>* xcons(list_node<Elem>* l, Elem x);
-
-
-template<class Elem>
-list_node<Elem>* list_node<Elem>::nil() { return new nil_node<Elem>(); }
-
-template<class Elem>
-list_node<Elem>* list_node<Elem>::single(Elem e) { return new single_list_node<Elem>(e); }
-
-template<class Elem>
-list_node<Elem>* list_node<Elem>::append(list_node<Elem>* l1, list_node<Elem>* l2) {
-  return new append_node<Elem>(l1, l2);
+list_node<Elem>* list_node<Elem>::single(Elem e) {
+  auto l = new list_node<Elem>();
+  l->push_back(e);
+  return l;
 }
 
-
-///////////////////////////////////////////////////////////////////////////
-//
-// list_node::nth
-//
-// function to find the nth element of the list
-//
-///////////////////////////////////////////////////////////////////////////
-
-template<class Elem>
-Elem list_node<Elem>::nth(int n) {
-  int len;
-  Elem tmp = nth_length(n, len);
-
-  if (tmp) {
-    return tmp;
-  } else {
-    cerr << "error: outside the range of the list\n";
-    exit(1);
-  }
-}
-
-// added 10/30/06 cgs
 template<class Elem>
-Elem append_node<Elem>::nth(int n) {
-  int len;
-  Elem tmp = nth_length(n, len);
-
-  if (tmp) {
-    return tmp;
-  } else {
-    cerr << "error: outside the range of the list\n";
-    exit(1);
+list_node<Elem>* list_node<Elem>::append(list_node<Elem>* l1, list_node<Elem>* l2) {
+  // the parser's error rules leave NULL lists behind
+  if (!l1 || !l2) { return l1 ? l1 : l2; }
+  for (auto e : *l2) {
+    l1->push_back(e);
   }
-}
-
-///////////////////////////////////////////////////////////////////////////
-//
-// nil_node::copy_list
-//
-// return the deep copy of the nil_node
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-list_node<Elem>* nil_node<Elem>::copy_list() {
-  return new nil_node<Elem>();
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// nil_node::len
-//
-// return the length of the nil_node
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-int nil_node<Elem>::len() {
-  return 0;
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// nil_node::nth_length
-//
-// return the nth element on the list
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-Elem nil_node<Elem>::nth_length(int, int& len) {
-  len = 0;
-  return NULL;
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// nil_node::dump
-//
-// dump for list node
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-void nil_node<Elem>::dump(ostream& stream, int n) {
-  stream << pad(n) << "(nil)\n";
+  return l1;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////
 //
-// single_list_node::copy_list
+// list_node::push_back
 //
-// return the deep copy of the single_list_node
+// add an element at the end, doubling the array when it is full; the
+// old array stays in the arena
 //
 ///////////////////////////////////////////////////////////////////////////
 template<class Elem>
-list_node<Elem>* single_list_node<Elem>::copy_list() {
-  return new single_list_node<Elem>((Elem)elem->copy());
+void list_node<Elem>::push_back(Elem e) {
+  if (length == capacity) {
+    capacity = capacity ? capacity * 2 : 4;
+    auto grown = static_cast<Elem*>(tree_arena_alloc(capacity * sizeof(Elem)));
+    for (int i = 0; i < length; i++) {
+      grown[i] = elems[i];
+    }
+    elems = grown;
+  }
+  elems[length++] = e;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////
 //
-// single_list_node::len
+// list_node::nth
 //
-// return the length of the single_list_node
+// function to find the nth element of the list
 //
 ///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-int single_list_node<Elem>::len() {
-  return 1;
-}
 
-
-///////////////////////////////////////////////////////////////////////////
-//
-// single_list_node::nth_length
-//
-// return the nth element on the list
-//
-///////////////////////////////////////////////////////////////////////////
 template<class Elem>
-Elem single_list_node<Elem>::nth_length(int n, int& len) {
-  len = 1;
-  if (n) {
-    return NULL;
+Elem list_node<Elem>::nth(int n) {
+  if (n >= 0 && n < length) {
+    return elems[n];
   } else {
-    return elem;
+    cerr << "error: outside the range of the list\n";
+    exit(1);
   }
 }
 
 
 ///////////////////////////////////////////////////////////////////////////
 //
-// single_list_node::dump
+// list_node::copy_list
 //
-// dump for list node
+// return the deep copy of the list
 //
 ///////////////////////////////////////////////////////////////////////////
 template<class Elem>
-void single_list_node<Elem>::dump(ostream& stream, int n) {
-  elem->dump(stream, n);
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// append_node::copy_list
-//
-// return the deep copy of the append_node
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-list_node<Elem>* append_node<Elem>::copy_list() {
-  return new append_node<Elem>(some->copy_list(), rest->copy_list());
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// append_node::len
-//
-// return the length of the append_node
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-int append_node<Elem>::len() {
-  return some->len() + rest->len();
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// append_node::nth_length
-//
-// return the nth element on the list
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-Elem append_node<Elem>::nth_length(int n, int& len) {
-  int rlen;
-  Elem tmp = some->nth_length(n, len);
-
-  if (!tmp) {
-    tmp = rest->nth_length(n - len, rlen);
-    len += rlen;
+list_node<Elem>* list_node<Elem>::copy_list() {
+  auto l = new list_node<Elem>();
+  for (auto e : *this) {
+    l->push_back((Elem) e->copy());
   }
-  return tmp;
+  return l;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////
 //
-// append_node::dump
+// list_node::dump
 //
 // dump for list node
 //
 ///////////////////////////////////////////////////////////////////////////
 template<class Elem>
-void append_node<Elem>::dump(ostream& stream, int n) {
-  int i, size;
-
-  size = len();
+void list_node<Elem>::dump(ostream& stream, int n) {
+  if (length == 0) {
+    stream << pad(n) << "(nil)\n";
+    return;
+  }
   stream << pad(n) << "list\n";
-  for (i = 0; i < size; i++) {
-    nth(i)->dump(stream, n + 2);
+  for (auto e : *this) {
+    e->dump(stream, n + 2);
   }
   stream << pad(n) << "(end_of_list)\n";
 }
 
-
-///////////////////////////////////////////////////////////////////////////
-//
-// list
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-single_list_node<Elem>* list(Elem x) {
-  return new single_list_node<Elem>(x);
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// cons
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-append_node<Elem>* cons(Elem x, list_node<Elem>* l) {
-  return new append_node<Elem>(list(x), l);
-}
-
-
-///////////////////////////////////////////////////////////////////////////
-//
-// xcons
-//
-///////////////////////////////////////////////////////////////////////////
-template<class Elem>
-append_node<Elem>* xcons(list_node<Elem>* l, Elem x) {
-  return new append_node<Elem>(l, list(x));
-}
-
 #endif /* TREE_H */
@@ -10,11 +10,17 @@
 //      print_cool_token       print a cool token and its semantic value
 //      dump_cool_token        dump a readable token representation
 //      strdup                 duplicate a string (missing from some libraries)
+//      map_source             map a source file for the lexer
+//      read_source            map or else read a source file for the lexer
 //
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "cool.h"
 #include <ctype.h>       // for isprint
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "stringtab.h"   // Symbol <-> String conversions
 #include "utilities.h"
 
@@ -116,40 +122,40 @@ char *cool_token_to_string(int tok)
   }
 }
 
-void print_cool_token(int tok)
+void print_cool_token(ostream& out, int tok)
 {
 
-  cerr << cool_token_to_string(tok);
+  out << cool_token_to_string(tok);
 
   switch (tok) {
   case (STR_CONST):
-    cerr << " = ";
-    cerr << " \"";
-    print_escaped_string(cerr, cool_yylval.symbol->get_string());
-    cerr << "\"";
+    out << " = ";
+    out << " \"";
+    print_escaped_string(out, cool_yylval.symbol->get_string());
+    out << "\"";
 #ifdef CHECK_TABLES
     stringtable.lookup_string(cool_yylval.symbol->get_string());
 #endif
     break;
   case (INT_CONST):
-    cerr << " = " << cool_yylval.symbol;
+    out << " = " << cool_yylval.symbol;
 #ifdef CHECK_TABLES
     inttable.lookup_string(cool_yylval.symbol->get_string());
 #endif
     break;
   case (BOOL_CONST):
-    cerr << (cool_yylval.boolean ? " = true" : " = false");
+    out << (cool_yylval.boolean ? " = true" : " = false");
     break;
   case (TYPEID):
   case (OBJECTID):
-    cerr << " = " << cool_yylval.symbol;
+    out << " = " << cool_yylval.symbol;
 #ifdef CHECK_TABLES
     idtable.lookup_string(cool_yylval.symbol->get_string());
 #endif
     break;
   case (ERROR): 
-    cerr << " = ";
-    print_escaped_string(cerr, cool_yylval.error_msg);
+    out << " = ";
+    print_escaped_string(out, cool_yylval.error_msg);
     break;
   }
 }
@@ -229,3 +235,50 @@ char *pad(int n) {
     if (n <= 0)  return "";
     return padding+(80-n);
 }
+
+//
+// The mapping is writable (copy on write) because flex writes null bytes
+// into the buffer it scans.  An anonymous mapping is reserved first, so
+// the two null bytes are there even when the file ends on a page
+// boundary.
+//
+char* map_source(FILE* f, size_t* size) {
+  struct stat st;
+  int fd = fileno(f);
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    return NULL;
+  }
+  size_t len = st.st_size;
+  void* base = mmap(NULL, len + 2, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) { return NULL; }
+  if (mmap(base, len, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(base, len + 2);
+    return NULL;
+  }
+  *size = len;
+  return (char*) base;
+}
+
+//
+// The source in f followed by two null bytes, mapped if possible and
+// otherwise read into memory, so that the lexer always scans a buffer.
+//
+char* read_source(FILE* f, size_t* size) {
+  if (char* base = map_source(f, size)) { return base; }
+  size_t len = 0, capacity = 1 << 16;
+  char* base = (char*) malloc(capacity);
+  size_t n;
+  while (base && (n = fread(base + len, 1, capacity - len - 2, f)) > 0) {
+    len += n;
+    if (capacity - len - 2 == 0) {
+      capacity *= 2;
+      base = (char*) realloc(base, capacity);
+    }
+  }
+  if (!base) { return NULL; }
+  base[len] = base[len + 1] = '\0';
+  *size = len;
+  return base;
+}
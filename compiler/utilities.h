@@ -2,6 +2,7 @@
 #define _UTILITIES_H_
 
 
+#include <stdio.h>
 #include "cool-io.h"
 
 /* Locations */
@@ -11,15 +12,26 @@
 #endif
 #include "cool-parse.h"
 
+// A file with more lex and parse errors is not parsed any further
+#define MAX_PARSE_ERRORS 50
+
+// The value of the last token from the lexer, on this thread
+extern thread_local YYSTYPE cool_yylval;
+
 extern char* cool_token_to_string(int tok);
 
-extern void print_cool_token(int tok);
+extern void print_cool_token(ostream& out, int tok);
 
 extern void fatal_error(char*);
 
 extern void print_escaped_string(ostream& str, const char* s);
 
 extern char* pad(int);
+
+// Map the file privately, followed by two null bytes.  Returns NULL if
+// it cannot be mapped (empty file, pipe).
+extern char* map_source(FILE* f, size_t* size);
+extern char* read_source(FILE* f, size_t* size);
 /*  On some machines strdup is not in the standard library. */
 //char *strdup(const char *s);
 extern void dump_cool_token(ostream& out, int lineno,
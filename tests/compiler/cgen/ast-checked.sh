@@ -0,0 +1,7 @@
+# A program compiled from the type checked AST coolc -S -A saved of it,
+# without type checking it again
+. `dirname $0`/script-common.sh
+$bin/coolc -S -A $tmp/prog.ast $dir/bigexample.cl &&
+$bin/coolc $tmp/prog.ast -o $tmp/prog.s &&
+simulate $tmp/prog.s
+finish
@@ -0,0 +1,6 @@
+# A program compiled from the AST coolc -P -A saved of it
+. `dirname $0`/script-common.sh
+$bin/coolc -P -A $tmp/prog.ast $dir/bigexample.cl &&
+$bin/coolc $tmp/prog.ast -o $tmp/prog.s &&
+simulate $tmp/prog.s
+finish
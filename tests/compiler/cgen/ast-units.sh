@@ -0,0 +1,9 @@
+# Half of a program saved as an AST with -P -A and compiled with -u
+# along with the source of the other half: the classes loaded from the
+# AST file go to its unit
+. `dirname $0`/script-common.sh
+cp $dir/split-main.cl $tmp
+$bin/coolc -P -A $tmp/list.ast $dir/split-list.cl &&
+$bin/coolc -u $tmp/list.ast $tmp/split-main.cl -o $tmp/link.s &&
+simulate $tmp/link.s $tmp/list.s $tmp/split-main.s
+finish
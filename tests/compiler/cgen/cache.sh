@@ -0,0 +1,27 @@
+# coolc -C: a second compile from the cache is the same as the first, and
+# after an ancestor's layout changes or the classes are reordered the
+# code from the cache is the same as without it, with -c as well
+. `dirname $0`/script-common.sh
+cp $dir/split-list.cl $dir/split-main.cl $tmp
+cd $tmp
+same() {
+  cmp -s $1 $2 && echo "$3: same code" || echo "$3: different code"
+}
+$bin/coolc -C cache split-list.cl split-main.cl -o cold.s
+$bin/coolc -C cache split-list.cl split-main.cl -o warm.s
+same cold.s warm.s "warm cache"
+# an attribute more in List moves those of Stack
+sed 's/next : List;/next : List; size : Int <- 1;/' split-list.cl > list.cl
+$bin/coolc -C cache list.cl split-main.cl -o warm.s
+$bin/coolc list.cl split-main.cl -o cold.s
+same cold.s warm.s "ancestor layout"
+# the other order numbers the classes and constants differently
+$bin/coolc -C cache split-main.cl list.cl -o warm.s
+$bin/coolc split-main.cl list.cl -o cold.s
+same cold.s warm.s "reordered"
+# -c adds comments to the code
+$bin/coolc -c -C cache split-main.cl list.cl -o debug-warm.s > /dev/null
+$bin/coolc -c split-main.cl list.cl -o debug-cold.s > /dev/null
+same debug-cold.s debug-warm.s "-c"
+simulate $tmp/warm.s
+finish
@@ -0,0 +1,45 @@
+(* Methods of the same name at different dispatch table slots in
+   unrelated hierarchies, overriding, and inherited attributes *)
+class A {
+  a : Int <- 1;
+  f() : Int { a };
+  g() : Int { a + 1 };
+};
+
+class B {
+  b : Int <- 10;
+  g() : Int { b };
+};
+
+class C inherits B {
+  c : Int <- 100;
+  f() : Int { b + c };
+  g() : Int { c };
+};
+
+class D inherits A {
+  d : Int <- 1000;
+  g() : Int { a + d };
+  h() : Int { d };
+};
+
+class E inherits D {
+  f() : Int { a + d + 10000 };
+};
+
+class Main inherits IO {
+  show(i : Int) : Object { { out_int(i); out_string(" "); } };
+
+  main() : Object {
+    let a : A <- new A, ad : A <- new D, ae : A <- new E,
+        b : B <- new B, bc : B <- new C, c : C <- new C, e : E <- new E in {
+      show(a.f()); show(a.g());
+      show(ad.f()); show(ad.g());
+      show(ae.f()); show(ae.g());
+      out_string("\n");
+      show(b.g()); show(bc.g()); show(c.f()); show(c.g());
+      show(e.h()); show(e@D.f()); show(e@A.g());
+      out_string("\n");
+    }
+  };
+};
@@ -0,0 +1,42 @@
+(* Arithmetic results on both sides of the small Int cache bounds
+   (-128..1023), and Ints made by the runtime *)
+class Main inherits IO {
+  show(i : Int) : Object {{ out_int(i); out_string(" "); }};
+
+  main() : Object {{
+    show(1000 + 23);
+    show(1000 + 24);
+    show(0 - 128);
+    show(0 - 129);
+    show(~128);
+    show(~129);
+    show(32 * 32 - 1);
+    show(32 * 32);
+    show(2047 / 2);
+    show(2048 / 2);
+    out_string("\n");
+    -- a counter walking through the whole range and out of it
+    let i : Int <- ~200, sum : Int <- 0 in {
+      while i < 1100 loop {
+        sum <- sum + i;
+        i <- i + 1;
+      } pool;
+      show(i);
+      show(sum);
+    };
+    out_string("\n");
+    -- equal results are equal objects as far as Cool can tell
+    let a : Int <- 6 * 7, b : Int <- 84 / 2, c : Int <- 4000 + 2 in {
+      if a = b then out_string("eq ") else out_string("ne ") fi;
+      if c = c + 0 then out_string("eq ") else out_string("ne ") fi;
+      case a of x : Int => show(x); esac;
+    };
+    out_string("\n");
+    let s : String <- "abc".concat("defg") in {
+      show(s.length());
+      show(s.substr(2, 3).length());
+      show(s.concat(s).length() + s.length());
+    };
+    out_string("\n");
+  }};
+};
@@ -0,0 +1,25 @@
+(* A table larger than the runtime's output buffer, numbers of every
+   sign and width, and an abort that must come after all the output *)
+class Main inherits IO {
+  main() : Object {{
+    let i : Int <- 0 in
+      while i < 300 loop {
+        out_int(i);
+        out_string("\t");
+        out_int(i * i * i - 13500000);
+        out_string(if i - i / 7 * 7 = 0 then "\n" else " | " fi);
+        i <- i + 1;
+      } pool;
+    out_string("\n");
+    out_int(~2147483647 - 1);
+    out_string(" ");
+    out_int(2147483647);
+    out_string(" ");
+    out_int(~7);
+    out_string(" ");
+    out_int(0);
+    out_string("\nno newline before abort: ");
+    abort();
+    out_string("not reached\n");
+  }};
+};
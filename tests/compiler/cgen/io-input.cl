@@ -0,0 +1,35 @@
+(* Input through the runtime's buffer, from io-input.cl.in: lines, an
+   empty line, lines longer than a string and than the buffer, in_int's
+   255 byte limit, a last line without a newline, and end of file *)
+class Main inherits IO {
+  line(s : String) : Object {{
+    out_int(s.length());
+    out_string(" [");
+    out_string(if 20 < s.length() then s.substr(0, 20) else s fi);
+    out_string("]\n");
+  }};
+
+  number(i : Int) : Object {{ out_int(i); out_string("\n"); }};
+
+  main() : Object {{
+    line(in_string());
+    number(in_int());
+    line(in_string());
+    -- 1500 bytes: the string gets 1025 of them, the next one the rest
+    line(in_string());
+    line(in_string());
+    number(in_int());
+    -- in_int stops after 255 bytes of the line, in_string gets the rest
+    number(in_int());
+    line(in_string());
+    -- 3000 bytes, refilling the 4096 byte buffer on the way
+    line(in_string());
+    line(in_string());
+    line(in_string());
+    line(in_string());
+    line(in_string());
+    -- end of file
+    line(in_string());
+    number(in_int());
+  }};
+};
@@ -0,0 +1,23 @@
+# Sourced by the .sh cgen cases, run with the directory of coolc as $1.
+# Sets bin to it, dir to the directory of the cases and tmp to a scratch
+# directory, which finish removes.
+bin=$1
+dir=`cd \`dirname $0\` && pwd`
+sim=$bin/coolrun
+[ -x $sim ] || sim=spim
+trap_file=$dir/../../../runtime/mips.handler
+tmp=`mktemp -d`
+
+# Run the program made of the assembly files given
+simulate() {
+  files=
+  for f in "$@"; do files="$files -file $f"; done
+  $sim -trap_file $trap_file $files
+}
+
+# Remove tmp and exit with the status of the command before
+finish() {
+  status=$?
+  rm -rf $tmp
+  exit $status
+}
@@ -0,0 +1,46 @@
+# coolc -i: each response is a header line and the stdout and stderr its
+# sizes give, and every request gets what coolc run on its own gives: the
+# exit status, the output and the code
+. `dirname $0`/script-common.sh
+mkdir $tmp/served $tmp/alone
+cp $dir/split-list.cl $dir/split-main.cl $tmp
+printf 'class Main {\n  main() : Int { "no" };\n};\n' > $tmp/bad.cl
+cat > $tmp/requests <<REQUESTS
+$tmp/split-list.cl $tmp/split-main.cl -o $tmp/served/prog.s
+$tmp/bad.cl -o $tmp/served/bad.s
+-P $tmp/split-list.cl
+-O -g $tmp/split-list.cl $tmp/split-main.cl -o $tmp/served/opt.s
+REQUESTS
+$bin/coolc -i -j 1 < $tmp/requests > $tmp/responses
+perl -e '
+  open(R, "<", $ARGV[0]) or die;
+  local $/;
+  my $r = <R>;
+  while (length $r) {
+    $r =~ s/^(\d+) (\d+) (\d+) (\d+)\n// or die "bad response header\n";
+    my ($id, $status, $out, $err) = ($1, $2, $3, $4);
+    length($r) >= $out + $err or die "response $id is short\n";
+    open(F, ">", "$ARGV[1]/$id.out"); print F substr($r, 0, $out); close F;
+    open(F, ">", "$ARGV[1]/$id.err"); print F substr($r, $out, $err); close F;
+    open(F, ">", "$ARGV[1]/$id.status"); print F "$status\n"; close F;
+    $r = substr($r, $out + $err);
+    printf "response %d: exit status %d, %s output, %s errors\n", $id, $status,
+      $out ? "some" : "no", $err ? "some" : "no";
+  }' $tmp/responses $tmp/served
+i=0
+while read request; do
+  $bin/coolc `echo $request | sed 's,/served/,/alone/,'` \
+    > $tmp/alone/$i.out 2> $tmp/alone/$i.err
+  echo $? > $tmp/alone/$i.status
+  same=yes
+  for f in $i.out $i.err $i.status; do
+    cmp -s $tmp/served/$f $tmp/alone/$f || same=no
+  done
+  echo "request $i same as coolc: $same"
+  i=`expr $i + 1`
+done < $tmp/requests
+for f in prog.s opt.s; do
+  cmp -s $tmp/served/$f $tmp/alone/$f && echo "$f: same code" || echo "$f: different code"
+done
+simulate $tmp/served/prog.s
+finish
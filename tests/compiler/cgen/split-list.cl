@@ -0,0 +1,13 @@
+(* The library half of a program split over two files: Main is in split-main.cl *)
+class List inherits IO {
+  item : String <- "nil";
+  next : List;
+
+  cons(s : String) : List { (new List).init(s, self) };
+  init(s : String, n : List) : List { { item <- s; next <- n; self; } };
+  length() : Int { if isvoid next then 0 else 1 + next.length() fi };
+  print() : Object {
+    if isvoid next then out_string("\n")
+    else { out_string(item.concat(" ")); next.print(); } fi
+  };
+};
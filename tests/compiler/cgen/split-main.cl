@@ -0,0 +1,21 @@
+(* The other half of a program split over two files: List is in split-list.cl *)
+class Stack inherits List {
+  top : String <- "stack: ";
+
+  cons(s : String) : List { (new Stack).init(s, self) };
+  print() : Object { { out_string(top); self@List.print(); } };
+};
+
+class Main inherits IO {
+  main() : Object {
+    let l : List <- (new Stack).cons("a").cons("b").cons("c") in {
+      l.print();
+      out_int(l.length());
+      out_string("\n");
+      case l of
+        s : Stack => out_string("a Stack\n");
+        o : List => out_string("a List\n");
+      esac;
+    }
+  };
+};
@@ -0,0 +1,13 @@
+# A program split over two files: compiled together into one file, and
+# with -u into a unit for each file and the link file, loaded together.
+# The -o file may not be one of the units.
+. `dirname $0`/script-common.sh
+cp $dir/split-list.cl $dir/split-main.cl $tmp
+$bin/coolc $tmp/split-list.cl $tmp/split-main.cl -o $tmp/all.s &&
+simulate $tmp/all.s
+$bin/coolc -u $tmp/split-list.cl $tmp/split-main.cl -o $tmp/link.s &&
+simulate $tmp/link.s $tmp/split-list.s $tmp/split-main.s
+# -o naming the unit of an input file is refused
+$bin/coolc -u $tmp/split-list.cl $tmp/split-main.cl -o $tmp/split-main.s \
+  2> /dev/null || echo "-o a unit: refused"
+finish
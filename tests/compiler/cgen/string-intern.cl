@@ -0,0 +1,49 @@
+(* String equality against constants, on constants and on strings
+   built by concat, which coolc -O interns *)
+class Main inherits IO {
+  show(b : Bool) : Object {
+    if b then out_string("T") else out_string("F") fi
+  };
+
+  lookup(cmd : String) : Int {
+    if cmd = "add" then 1 else
+    if cmd = "sub" then 2 else
+    if cmd = "mul" then 3 else
+    0 fi fi fi
+  };
+
+  main() : Object {{
+    -- decided at compile time
+    show("abc" = "abc");
+    show("abc" = "abd");
+    show("" = "");
+    out_string("\n");
+    -- distinct constants of the same length
+    let a : String <- "add", s : String <- "sub" in {
+      show(a = s);
+      show(a = "add");
+      show(s = "sub");
+    };
+    out_string("\n");
+    -- concatenations that equal a constant, and some that do not
+    show("ad".concat("d") = "add");
+    show("s".concat("ub") = "sub");
+    show("su".concat("x") = "sub");
+    show("add".concat("") = "add");
+    show("x".concat("y") = "x".concat("y"));
+    show("x".concat("y") = "y".concat("x"));
+    out_string("\n");
+    out_int(lookup("a".concat("dd")));
+    out_int(lookup("m".concat("ul")));
+    out_int(lookup("d".concat("iv")));
+    out_int(lookup("su".concat("b")));
+    out_string("\n");
+    -- the shared constant still behaves like a fresh string
+    let t : String <- "mu".concat("l") in {
+      out_string(t.concat(t));
+      out_int(t.length());
+      out_string(t.substr(1, 2));
+    };
+    out_string("\n");
+  }};
+};
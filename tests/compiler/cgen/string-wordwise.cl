@@ -0,0 +1,41 @@
+(* Equality, concat and substr on strings of every length modulo 4,
+   aligned and unaligned *)
+class Main inherits IO {
+  alphabet : String <- "abcdefghijklmnopqrstuvwxyz";
+
+  check(name : String, b : Bool) : Object {
+    if b then self else { out_string(name); out_string(" failed\n"); } fi
+  };
+
+  main() : Object {{
+    let i : Int <- 0 in
+      while i <= 10 loop
+        let j : Int <- 0,
+            s : String <- alphabet.substr(0, i) in {
+          check("eq copy", s = s.copy());
+          check("eq concat", s = alphabet.substr(0, i).concat(""));
+          while j <= 10 - i loop
+            let t : String <- alphabet.substr(j, i) in {
+              -- substr from every source alignment
+              check("substr length", t.length() = i);
+              if 0 < i then check("substr", (j = 0) = (t = s)) else self fi;
+              -- concat onto every destination alignment
+              out_string(s.concat(t));
+              out_string("|");
+              -- strings differing in the last byte only
+              if 0 < i then
+                check("last byte", not (t = t.substr(0, i - 1).concat("#")))
+              else self fi;
+              j <- j + 1;
+            }
+          pool;
+          out_string("\n");
+          i <- i + 1;
+        }
+      pool;
+    check("same length", not ("abcdefgh" = "abcdefgX"));
+    check("word differs", not ("abcdefgh" = "abcXefgh"));
+    check("lengths", not ("abcd" = "abcde"));
+    out_string("done\n");
+  }};
+};
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# Check that two coolc lex alike: the tokens coolc -L dumps of the lexer
+# tests and of a synthetic program from coolbench must be the same.
+# "make lexcheck" runs it on the flex lexer and the hand-written one.
+#
+# usage: lexcompare.sh coolc-a coolc-b coolbench
+#
+
+A=$1
+B=$2
+BENCH=$3
+DIR=`dirname $0`
+
+TMP=`mktemp -d`
+$BENCH -c 200 -s 200 -d 20 -o $TMP/synthetic.cl > /dev/null || exit 1
+
+status=0
+count=0
+for f in $DIR/lexer/*.cool $TMP/synthetic.cl
+do
+  $A -L $f > $TMP/a.out 2>&1
+  $B -L $f > $TMP/b.out 2>&1
+  if ! cmp -s $TMP/a.out $TMP/b.out
+  then
+    echo "Tokens differ for $f:"
+    diff $TMP/a.out $TMP/b.out | head -20
+    status=1
+  fi
+  count=`expr $count + 1`
+done
+[ $status = 0 ] && echo "$count files lex alike"
+rm -rf $TMP
+exit $status
@@ -248,6 +248,7 @@ foreach my $caseref (@cases) {
 	    system("ps -g $gpid | grep -i $executable | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
 	    #system("ps -g $gpid | grep -i $preprocessor | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
 	    system("ps -g $gpid | grep -i spim | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
+	    system("ps -g $gpid | grep -i coolrun | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
 	    system("ps -g $gpid | grep -i java | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
 	    system("ps -g $gpid | grep -i cgen | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
 	    system("ps -g $gpid | grep -i lexer | awk '{print \$1}' | xargs kill -9 > /dev/null 2>&1");
@@ -280,6 +281,13 @@ foreach my $caseref (@cases) {
 	    $retval = system("$binarydir/$executable $TESTS_DIR/$casefile > $testout 2>&1");
 	    $retval = 0;
 	} elsif ( $testcase eq "cgen" ) {
+	    # the program reads $casefile.in if there is one, or nothing
+	    my $input = -e "$TESTS_DIR/$casefile.in" ? "$TESTS_DIR/$casefile.in" : "/dev/null";
+	    # a .sh case compiles and runs its program its own way (several
+	    # files, a cache, the server), printing what the program printed
+	    if ($casefile =~ m/\.sh$/) {
+		$retval = system("sh $TESTS_DIR/$casefile $binarydir < $input > $testout 2>&1");
+	    } else {
 	    # modif by Pierre Pont - 12/03/04
 	    # if the case name contains "-gc", run coolc with Garbage Collection enabled
 	    if ($casefile =~ m/-gc/) {
@@ -291,9 +299,12 @@ foreach my $caseref (@cases) {
 	    if (($retval != 0)) {
 		system("mv $casefile.s $testout");
 	    } else {
-		$retval = system("spim -trap_file ../../runtime/mips.handler -file $casefile.s > $testout 2>&1");
+		# prefer the simulator built next to coolc over spim
+		my $simulator = -x "$binarydir/coolrun" ? "$binarydir/coolrun" : "spim";
+		$retval = system("$simulator -trap_file ../../runtime/mips.handler -file $casefile.s < $input > $testout 2>&1");
 		system("rm $casefile.s");
 	    }
+	    }
 	} elsif ( $testcase eq "optimize" ) {
 	    #send output to /dev/null because some people have _insane_ amounts
 	    #of debug output.